@@ -0,0 +1,672 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Single-pass analyzer of the Cooja logs of app.c (the records of parse-stats.py), for runs too
+ * long for the Python script.
+ *
+ * The log is memory-mapped (or read as a stream from stdin or a pipe) and every line is matched
+ * once against the "App:" records, with hand-written matchers. Memory is bounded: for every node
+ * only the last packets sent (a window) are kept, to match their receptions. A reception of a
+ * packet no longer in the window is still counted, without latency and duplicate detection.
+ *
+ * Prints the same statistics of parse-stats.py (PDR/PLR per node and overall, for data collection
+ * and source routing), followed by the end-to-end latency percentiles, the hop-count
+ * distribution, the duplicates and the per-node breakdowns, and writes recv.csv, sent.csv (as
+ * parse-stats.py) and nodes.csv (per-node breakdowns).
+ */
+
+
+/* Analyzer config --------------------------------------------------------------------*/
+
+#define SINK_ID 1
+
+// Packets sent kept per node to match their receptions (default)
+#define WINDOW_SIZE 256
+
+// Node ids are 16-bit addresses
+#define MAX_NODES 0x10000
+
+#define MAX_HOPS 256
+
+// Latency histogram: log-linear buckets, 2^HIST_SUB_BITS per power of two (relative error < 3.2%)
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+
+/* Histograms -------------------------------------------------------------------------*/
+
+struct histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[HIST_BUCKETS];
+};
+
+static unsigned histogram_bucket(uint64_t value) {
+  if (value < 2 * HIST_SUB) {
+    return value;
+  }
+  unsigned e = 63 - __builtin_clzll(value);
+  return (e - HIST_SUB_BITS + 1) * HIST_SUB + ((value >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// Middle of the values of a bucket
+static uint64_t histogram_bucket_value(unsigned bucket) {
+  if (bucket < 2 * HIST_SUB) {
+    return bucket;
+  }
+  unsigned shift = bucket / HIST_SUB - 1;
+  return ((uint64_t)(HIST_SUB + bucket % HIST_SUB) << shift) + ((1ULL << shift) >> 1);
+}
+
+static void histogram_add(struct histogram *h, uint64_t value) {
+  if (h->count == 0 || value < h->min) {
+    h->min = value;
+  }
+  if (value > h->max) {
+    h->max = value;
+  }
+  h->count++;
+  h->sum += value;
+  h->buckets[histogram_bucket(value)]++;
+}
+
+static uint64_t histogram_percentile(const struct histogram *h, double percent) {
+  uint64_t rank = (uint64_t)(percent / 100 * h->count + 0.5);
+  uint64_t seen = 0;
+  unsigned b;
+
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    seen += h->buckets[b];
+    if (seen >= rank) {
+      uint64_t value = histogram_bucket_value(b);
+      return value < h->min ? h->min : value > h->max ? h->max : value;
+    }
+  }
+  return h->max;
+}
+
+
+/* Traffic ----------------------------------------------------------------------------*/
+
+/**
+ * Packet sent, in the window of its flow.
+ */
+struct packet {
+  uint64_t time;
+  uint16_t seqn;
+  bool received;
+};
+
+/**
+ * Packets of a node: sent by it (data collection) or to it (source routing).
+ */
+struct flow {
+  uint32_t sent;
+  uint32_t received;
+  uint32_t duplicates;
+  uint32_t unmatched;       // Receptions of packets no longer in the window
+  uint32_t latency_count;
+  uint64_t latency_sum;
+  uint64_t latency_max;
+  uint64_t hops_sum;
+
+  uint32_t window_next;     // Ring of the last packets sent
+  uint32_t window_count;
+  struct packet *window;
+};
+
+struct traffic {
+  const char *name;
+  const char *tag;          // Name in the CSV files
+  struct flow *flows[MAX_NODES];
+  struct histogram latency;
+  uint64_t hops[MAX_HOPS];
+};
+
+static struct traffic collect = {.name = "Data Collection", .tag = "dc"};
+static struct traffic source_routing = {.name = "Source Routing", .tag = "sr"};
+
+static uint32_t window_size = WINDOW_SIZE;
+
+static struct flow* flow_get(struct traffic *t, uint16_t node) {
+  struct flow *f = t->flows[node];
+
+  if (f == NULL) {
+    f = calloc(1, sizeof(struct flow));
+    if (f == NULL || (f->window = calloc(window_size, sizeof(struct packet))) == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    t->flows[node] = f;
+  }
+  return f;
+}
+
+static void traffic_sent(struct traffic *t, uint16_t node, uint16_t seqn, uint64_t time) {
+  struct flow *f = flow_get(t, node);
+  struct packet *p = &f->window[f->window_next];
+
+  p->time = time;
+  p->seqn = seqn;
+  p->received = false;
+  f->window_next = (f->window_next + 1) % window_size;
+  if (f->window_count < window_size) {
+    f->window_count++;
+  }
+  f->sent++;
+}
+
+static void traffic_received(struct traffic *t, uint16_t node, uint16_t seqn, unsigned hops, uint64_t time) {
+  struct flow *f = flow_get(t, node);
+  struct packet *p = NULL;
+  uint32_t i, slot;
+
+  // Most recent packet with the seqn (packets are usually received soon after being sent)
+  for (i = 1; i <= f->window_count; i++) {
+    slot = (f->window_next + window_size - i) % window_size;
+    if (f->window[slot].seqn == seqn) {
+      p = &f->window[slot];
+      break;
+    }
+  }
+
+  if (p == NULL) {
+    f->unmatched++;
+  } else if (p->received) {
+    f->duplicates++;
+    return;
+  } else {
+    p->received = true;
+    uint64_t latency = time >= p->time ? time - p->time : 0;
+    histogram_add(&t->latency, latency);
+    f->latency_count++;
+    f->latency_sum += latency;
+    if (latency > f->latency_max) {
+      f->latency_max = latency;
+    }
+  }
+  f->received++;
+  f->hops_sum += hops;
+  t->hops[hops < MAX_HOPS ? hops : MAX_HOPS - 1]++;
+}
+
+
+/* Parsing ----------------------------------------------------------------------------*/
+
+static uint16_t sink_id = SINK_ID;
+
+// Time unit of the logs with times as plain numbers (us: Cooja script and simulator)
+static uint64_t time_unit = 1;
+
+static bool nodes_booted[MAX_NODES];
+static unsigned resets = 0;
+
+static FILE *recv_csv = NULL;
+static FILE *sent_csv = NULL;
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static inline bool is_word(char c) {
+  return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool match_literal(const char **p, const char *end, const char *literal) {
+  size_t length = strlen(literal);
+
+  if ((size_t)(end - *p) < length || memcmp(*p, literal, length) != 0) {
+    return false;
+  }
+  *p += length;
+  return true;
+}
+
+static bool match_spaces(const char **p, const char *end) {
+  const char *start = *p;
+
+  while (*p < end && is_space(**p)) {
+    (*p)++;
+  }
+  return *p > start;
+}
+
+static bool match_uint(const char **p, const char *end, uint32_t *value) {
+  const char *start = *p;
+
+  *value = 0;
+  while (*p < end && is_digit(**p)) {
+    *value = *value * 10 + (**p - '0');
+    (*p)++;
+  }
+  return *p > start;
+}
+
+// Address byte printed as %02x
+static bool match_hex_byte(const char **p, const char *end, uint8_t *value) {
+  const char *start = *p;
+  char c;
+
+  *value = 0;
+  while (*p < end && is_word(c = **p)) {
+    if (is_digit(c)) {
+      *value = *value * 16 + (c - '0');
+    } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+      *value = *value * 16 + ((c | 0x20) - 'a' + 10);
+    } else {
+      return false;
+    }
+    (*p)++;
+  }
+  return *p > start;
+}
+
+// Node id of an address printed as %02x:%02x (u8[0] is the low byte)
+static bool match_address(const char **p, const char *end, uint16_t *node) {
+  uint8_t low, high;
+
+  if (!match_hex_byte(p, end, &low) || !match_literal(p, end, ":") || !match_hex_byte(p, end, &high)) {
+    return false;
+  }
+  *node = low | (high << 8);
+  return true;
+}
+
+/**
+ * Time of a record: a number in time_unit, or [[h:]m:]s[.fraction] (Cooja formatted time).
+ */
+static bool parse_time(const char *p, const char *end, uint64_t *time) {
+  uint64_t value = 0;
+  uint64_t seconds = 0;
+  uint64_t fraction = 0, scale = 1;
+  bool formatted = false;
+
+  for (; p < end && *p != '.'; p++) {
+    if (*p == ':') {
+      seconds = (seconds + value) * 60;
+      value = 0;
+      formatted = true;
+    } else if (is_digit(*p)) {
+      value = value * 10 + (*p - '0');
+    } else {
+      return false;
+    }
+  }
+  if (p == end && !formatted) {
+    *time = value * time_unit;
+    return true;
+  }
+  for (p = p < end ? p + 1 : end; p < end; p++) {
+    if (!is_digit(*p)) {
+      return false;
+    }
+    if (scale < 1000000) {
+      fraction = fraction * 10 + (*p - '0');
+      scale *= 10;
+    }
+  }
+  *time = (seconds + value) * 1000000 + fraction * (1000000 / scale);
+  return true;
+}
+
+static void line_process(const char *line, const char *end) {
+  const char *p = line;
+  const char *time_start, *time_end;
+  uint32_t self_id, seqn, hops, metric, a, b;
+  uint16_t node;
+  uint64_t time;
+
+  // Record: <time> ID:<node id> <text>
+  time_start = p;
+  while (p < end && (is_word(*p) || *p == ':' || *p == '.')) {
+    p++;
+  }
+  time_end = p;
+  if (time_end == time_start || !match_spaces(&p, end) || !match_literal(&p, end, "ID:") ||
+      !match_uint(&p, end, &self_id) || !match_spaces(&p, end) || self_id >= MAX_NODES) {
+    return;
+  }
+
+  if (match_literal(&p, end, "App: ")) {
+    if (!parse_time(time_start, time_end, &time)) {
+      return;
+    }
+
+    // Packet received by the sink
+    if (match_literal(&p, end, "Recv from ")) {
+      if (match_address(&p, end, &node) && match_literal(&p, end, " seqn ") && match_uint(&p, end, &seqn) &&
+          match_literal(&p, end, " hops ") && match_uint(&p, end, &hops)) {
+        if (recv_csv != NULL) {
+          fprintf(recv_csv, "%.*s\t%u\t%u\t%u\t%u\n", (int)(time_end - time_start), time_start, self_id, node, seqn, hops);
+        }
+        if (self_id == sink_id) {
+          traffic_received(&collect, node, seqn, hops, time);
+        }
+      }
+
+    // Packet sent by a node
+    } else if (match_literal(&p, end, "Send seqn ")) {
+      if (match_uint(&p, end, &seqn)) {
+        if (sent_csv != NULL) {
+          fprintf(sent_csv, "%.*s\t%u\t%u\t%u\n", (int)(time_end - time_start), time_start, sink_id, self_id, seqn);
+        }
+        traffic_sent(&collect, self_id, seqn, time);
+      }
+
+    // Command received by a node
+    } else if (match_literal(&p, end, "sr_recv from sink seqn ")) {
+      if (match_uint(&p, end, &seqn) && match_literal(&p, end, " hops ") && match_uint(&p, end, &hops) &&
+          match_literal(&p, end, " node metric ") && match_uint(&p, end, &metric)) {
+        traffic_received(&source_routing, self_id, seqn, hops, time);
+      }
+
+    // Command sent by the sink
+    } else if (match_literal(&p, end, "sink sending seqn ")) {
+      if (match_uint(&p, end, &seqn) && match_literal(&p, end, " to ") && match_address(&p, end, &node)) {
+        traffic_sent(&source_routing, node, seqn, time);
+      }
+    }
+
+  // Node boot
+  } else if (match_literal(&p, end, "Rime started with address ")) {
+    // <u8[0]>.<u8[1]>
+    if (match_uint(&p, end, &a) && p++ < end && match_uint(&p, end, &b)) {
+      if (nodes_booted[self_id]) {
+        resets++;
+        printf("WARNING: node %u reset during the simulation.\n", self_id);
+      }
+      nodes_booted[self_id] = true;
+    }
+  }
+}
+
+// Lines of a memory-mapped log
+static void log_process_mapped(const char *data, size_t length) {
+  const char *end = data + length;
+  const char *line, *line_end;
+
+  for (line = data; line < end; line = line_end + 1) {
+    line_end = memchr(line, '\n', end - line);
+    if (line_end == NULL) {
+      line_end = end;
+    }
+    line_process(line, line_end > line && line_end[-1] == '\r' ? line_end - 1 : line_end);
+  }
+}
+
+// Lines of a log read as a stream
+static void log_process_stream(FILE *file) {
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t length;
+
+  while ((length = getline(&line, &size, file)) > 0) {
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      length--;
+    }
+    line_process(line, line + length);
+  }
+  free(line);
+}
+
+static int log_process(const char *path) {
+  struct stat st;
+  FILE *file;
+  int fd;
+
+  if (strcmp(path, "-") == 0) {
+    log_process_stream(stdin);
+    return 0;
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    printf("Error: No such file.\n");
+    return 1;
+  }
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+      log_process_mapped(data, st.st_size);
+      munmap(data, st.st_size);
+      close(fd);
+      return 0;
+    }
+  }
+
+  // Not a regular file (or not mappable)
+  file = fdopen(fd, "r");
+  log_process_stream(file);
+  fclose(file);
+  return 0;
+}
+
+
+/* Output -----------------------------------------------------------------------------*/
+
+static inline double percent(uint64_t part, uint64_t total) {
+  return total > 0 ? 100.0 * part / total : 0;
+}
+
+static inline double ms(uint64_t us) {
+  return us / 1000.0;
+}
+
+// Statistics of parse-stats.py
+static void print_pdr(const struct traffic *t) {
+  uint64_t total_sent = 0, total_received = 0;
+  unsigned node;
+
+  printf("----- %s Node Statistics -----\n", t->name);
+  for (node = 0; node < MAX_NODES; node++) {
+    const struct flow *f = t->flows[node];
+    if (f != NULL && f->sent > 0) {
+      double pdr = percent(f->received, f->sent);
+      printf("Node %u: TX Packets = %u, RX Packets = %u, PDR = %.2f%%, PLR = %.2f%%\n",
+        node, f->sent, f->received, pdr, 100 - pdr);
+      total_sent += f->sent;
+      total_received += f->received;
+    }
+  }
+
+  if (total_sent > 0) {
+    double pdr = percent(total_received, total_sent);
+    printf("\n----- %s Overall Statistics -----\n", t->name);
+    printf("Total Number of Packets Sent: %llu\n", (unsigned long long)total_sent);
+    printf("Total Number of Packets Received: %llu\n", (unsigned long long)total_received);
+    printf("Overall PDR = %.2f%%\n", pdr);
+    printf("Overall PLR = %.2f%%\n", 100 - pdr);
+  }
+}
+
+static void print_details(const struct traffic *t) {
+  const struct histogram *h = &t->latency;
+  uint64_t received = 0, duplicates = 0, unmatched = 0;
+  unsigned node, hops;
+
+  for (node = 0; node < MAX_NODES; node++) {
+    const struct flow *f = t->flows[node];
+    if (f != NULL) {
+      received += f->received;
+      duplicates += f->duplicates;
+      unmatched += f->unmatched;
+    }
+  }
+  if (received == 0 && duplicates == 0) {
+    return;
+  }
+
+  printf("\n----- %s Latency -----\n", t->name);
+  printf("Packets: %llu (received without a matching send: %llu)\n",
+    (unsigned long long)h->count, (unsigned long long)unmatched);
+  if (h->count > 0) {
+    printf("Min = %.2f ms, Avg = %.2f ms, Max = %.2f ms\n", ms(h->min), ms(h->sum / h->count), ms(h->max));
+    printf("P50 = %.2f ms, P90 = %.2f ms, P95 = %.2f ms, P99 = %.2f ms\n",
+      ms(histogram_percentile(h, 50)), ms(histogram_percentile(h, 90)),
+      ms(histogram_percentile(h, 95)), ms(histogram_percentile(h, 99)));
+  }
+
+  printf("\n----- %s Hops -----\n", t->name);
+  for (hops = 0; hops < MAX_HOPS; hops++) {
+    if (t->hops[hops] > 0) {
+      printf("Hops %u%s: %llu (%.2f%%)\n", hops, hops == MAX_HOPS - 1 ? "+" : "",
+        (unsigned long long)t->hops[hops], percent(t->hops[hops], received));
+    }
+  }
+
+  printf("\n----- %s Node Details -----\n", t->name);
+  for (node = 0; node < MAX_NODES; node++) {
+    const struct flow *f = t->flows[node];
+    if (f != NULL) {
+      printf("Node %u: Duplicates = %u, Avg Latency = %.2f ms, Max Latency = %.2f ms, Avg Hops = %.2f\n",
+        node, f->duplicates, f->latency_count > 0 ? ms(f->latency_sum / f->latency_count) : 0,
+        ms(f->latency_max), f->received > 0 ? (double)f->hops_sum / f->received : 0);
+    }
+  }
+  printf("Total Number of Duplicates: %llu\n", (unsigned long long)duplicates);
+}
+
+static void write_nodes_csv(FILE *file, const struct traffic *t) {
+  unsigned node;
+
+  for (node = 0; node < MAX_NODES; node++) {
+    const struct flow *f = t->flows[node];
+    if (f != NULL) {
+      fprintf(file, "%s\t%u\t%u\t%u\t%u\t%.2f\t%.3f\t%.3f\t%.2f\n", t->tag, node, f->sent, f->received,
+        f->duplicates, percent(f->received, f->sent),
+        f->latency_count > 0 ? ms(f->latency_sum / f->latency_count) : 0, ms(f->latency_max),
+        f->received > 0 ? (double)f->hops_sum / f->received : 0);
+    }
+  }
+}
+
+
+/* Main -------------------------------------------------------------------------------*/
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options] <log file | ->\n"
+    "  -s <id>           node id of the sink (default: %d)\n"
+    "  -u <unit>         unit of the times written as numbers: us, ms, s (default: us)\n"
+    "  -w <packets>      packets sent kept per node to match the receptions (default: %d)\n"
+    "  -o <dir>          directory of the CSV files (default: .)\n"
+    "  -n                do not write the CSV files\n",
+    name, SINK_ID, WINDOW_SIZE);
+}
+
+static FILE* csv_open(const char *dir, const char *name, const char *header) {
+  char path[4096];
+  FILE *file;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  file = fopen(path, "w");
+  if (file == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fputs(header, file);
+  return file;
+}
+
+int main(int argc, char **argv) {
+  const char *csv_dir = ".";
+  bool csv = true;
+  FILE *nodes_csv;
+  unsigned node;
+  int opt, res;
+
+  while ((opt = getopt(argc, argv, "s:u:w:o:nh")) != -1) {
+    switch (opt) {
+      case 's': sink_id = strtoul(optarg, NULL, 10); break;
+      case 'u':
+        if (strcmp(optarg, "us") == 0) {
+          time_unit = 1;
+        } else if (strcmp(optarg, "ms") == 0) {
+          time_unit = 1000;
+        } else if (strcmp(optarg, "s") == 0) {
+          time_unit = 1000000;
+        } else {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 'w': window_size = strtoul(optarg, NULL, 10); break;
+      case 'o': csv_dir = optarg; break;
+      case 'n': csv = false; break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1 || window_size == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (csv) {
+    recv_csv = csv_open(csv_dir, "recv.csv", "time\tdest\tsrc\tseqn\thops\n");
+    sent_csv = csv_open(csv_dir, "sent.csv", "time\tdest\tsrc\tseqn\n");
+  }
+
+  res = log_process(argv[optind]);
+  if (res != 0) {
+    return res;
+  }
+
+  if (resets > 0) {
+    printf("----- WARNING -----\n");
+    printf("%u nodes reset during the simulation\n\n", resets);
+  }
+
+  // Nodes that did not manage to send data
+  bool fails = false;
+  for (node = 0; node < MAX_NODES; node++) {
+    if (nodes_booted[node] && node != sink_id && (collect.flows[node] == NULL || collect.flows[node]->sent == 0)) {
+      if (!fails) {
+        printf("----- Data Collection WARNING -----\n");
+        fails = true;
+      }
+      printf("Warning: node %u did not send any data.\n", node);
+    }
+  }
+  if (fails) {
+    printf("\n");
+  }
+
+  print_pdr(&collect);
+  printf("\n");
+  print_pdr(&source_routing);
+  print_details(&collect);
+  print_details(&source_routing);
+
+  if (csv) {
+    fclose(recv_csv);
+    fclose(sent_csv);
+    nodes_csv = csv_open(csv_dir, "nodes.csv",
+      "traffic\tnode\tsent\treceived\tduplicates\tpdr\tlatency_avg_ms\tlatency_max_ms\thops_avg\n");
+    write_nodes_csv(nodes_csv, &collect);
+    write_nodes_csv(nodes_csv, &source_routing);
+    fclose(nodes_csv);
+  }
+  return 0;
+}
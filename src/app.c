@@ -9,6 +9,8 @@
 /*---------------------------------------------------------------------------*/
 #define APP_UPWARD_TRAFFIC 1
 #define APP_DOWNWARD_TRAFFIC 1
+/* Send every downward message to all the nodes at once (sr_send_multi) */
+#define APP_DOWNWARD_MULTICAST 0
 /*---------------------------------------------------------------------------*/
 #define APP_NODES 10
 /*---------------------------------------------------------------------------*/
@@ -29,6 +31,8 @@ __attribute__((packed))
 test_msg_t;
 /*---------------------------------------------------------------------------*/
 static struct my_collect_conn my_collect;
+/* Routing table of the sink (a firmware of the routers only can leave it out) */
+static struct routing_table routing_table;
 static void recv_cb(const linkaddr_t *originator, uint8_t hops);
 /*
  * Source Routing Callback
@@ -54,15 +58,20 @@ PROCESS_THREAD(app_process, ev, data)
   static struct etimer periodic;
   static struct etimer rnd;
   static test_msg_t msg = {.seqn=0};
+#if APP_DOWNWARD_MULTICAST == 1
+  static linkaddr_t dests[APP_NODES - 1];
+  static int i;
+#else
   static uint8_t dest_low = 2;
   static linkaddr_t dest = {{0x00, 0x00}};
+#endif
   static int ret;
 
   PROCESS_BEGIN();
 
   if(linkaddr_cmp(&sink, &linkaddr_node_addr)) {
     printf("App: I am sink %02x:%02x\n", linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
-    my_collect_open(&my_collect, COLLECT_CHANNEL, true, &sink_cb);
+    my_collect_open(&my_collect, COLLECT_CHANNEL, true, &routing_table, &sink_cb);
 #if APP_DOWNWARD_TRAFFIC == 1
     /* Wait a bit longer at the beginning to gather enough topology information */
     etimer_set(&periodic, 75 * CLOCK_SECOND);
@@ -79,6 +88,19 @@ PROCESS_THREAD(app_process, ev, data)
       memcpy(packetbuf_dataptr(), &msg, sizeof(msg));
       packetbuf_set_datalen(sizeof(msg));
 
+#if APP_DOWNWARD_MULTICAST == 1
+      /* Send the packet downwards to all the nodes */
+      for(i = 0; i < APP_NODES - 1; i++) {
+        dests[i].u8[0] = i + 2;
+        dests[i].u8[1] = 0;
+      }
+      printf("App: sink sending seqn %d to all nodes\n", msg.seqn);
+      ret = sr_send_multi(&my_collect, dests, APP_NODES - 1);
+      if(ret == 0) {
+        printf("App: sink could not send seqn %d to all nodes\n", msg.seqn);
+      }
+      msg.seqn++;
+#else
       /* Change the Destination Link Address to a different node */
       dest.u8[0] = dest_low;
 
@@ -99,12 +121,13 @@ PROCESS_THREAD(app_process, ev, data)
       if(dest_low > APP_NODES) {
         dest_low = 2;
       }
+#endif /* APP_DOWNWARD_MULTICAST == 1 */
     }
 #endif /* APP_DOWNWARD_TRAFFIC == 1 */
   }
   else {
     printf("App: I am normal node %02x:%02x\n", linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
-    my_collect_open(&my_collect, COLLECT_CHANNEL, false, &node_cb);
+    my_collect_open(&my_collect, COLLECT_CHANNEL, false, NULL, &node_cb);
 #if APP_UPWARD_TRAFFIC == 1
     etimer_set(&periodic, MSG_PERIOD);
     while(1) {
@@ -0,0 +1,510 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+#include "my_routing_table.h"
+
+// Output of the benchmark itself (contiki.h redirects printf to the node output)
+#undef printf
+
+/**
+ * Microbenchmarks of the sink routing table: the functions run by the sink for every packet
+ * received (update of the <parent, child> pairs) and for every command sent (route computation),
+ * driven with synthetic trees of several shapes and sizes.
+ *
+ * For every <shape, nodes, operation> prints the time per operation and the heap allocations
+ * per operation (calls to malloc/calloc/realloc made by the code under test), and compares them
+ * with a baseline file: slower than the baseline by more than a threshold or with more
+ * allocations is a regression (exit status 1). Times are compared after scaling the baseline by
+ * the speed of the machine (a fixed loop timed at every run), so that a baseline stays usable
+ * on a busy or different machine, and a slowdown is a regression only if it is also larger than
+ * an absolute noise floor (ops of a few ns jitter by more than any sensible threshold).
+ */
+
+
+/* Bench config -----------------------------------------------------------------------*/
+
+#define SINK_ID 1
+
+// Destinations of the route operations (random, precomputed)
+#define DESTS_COUNT 4096
+
+// Min operations timed per clock read (the operations of small trees are repeated)
+#define BATCH_OPS 65536
+
+// Runs of a measure (the fastest is kept: runs are only ever slowed down by the rest of the system)
+#define MEASURE_RUNS 5
+
+// Iterations of the loop used to measure the speed of the machine
+#define CALIBRATION_LOOPS 10000000
+
+#define MAX_SIZES 16
+#define MAX_BASELINE 256
+
+enum shape {
+  SHAPE_LINE,     // Chains of max depth hanging from the sink
+  SHAPE_STAR,     // Every node is a child of the sink
+  SHAPE_BALANCED, // Binary tree
+  SHAPE_RANDOM,   // Random recursive tree: parent chosen uniformly among the previous nodes
+  SHAPE_COUNT
+};
+
+static const char *shape_names[SHAPE_COUNT] = {"line", "star", "balanced", "random"};
+
+enum op {
+  OP_INSERT,      // routing_table_update_entry() of a new child
+  OP_UPDATE,      // routing_table_update_entry() of a known child with the same parent
+  OP_GET_PARENT,  // routing_table_get_parent() of a random node
+  OP_ROUTE,       // routing_table_route_length() + routing_table_find_route_path() to a random node
+  OP_ROUTE_HIT,   // The same to the last destination (route cache hit)
+  OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {"insert", "update", "get_parent", "route", "route_hit"};
+
+struct result {
+  char shape[16];
+  unsigned nodes;
+  char op[16];
+  double ns_per_op;
+  double allocs_per_op;
+};
+
+
+/* Bench vars -------------------------------------------------------------------------*/
+
+static struct routing_table table;
+// Parent of every node (index = id - 1, the sink has no parent)
+static linkaddr_t *parents;
+static linkaddr_t dests[DESTS_COUNT];
+// Destination of OP_ROUTE_HIT: a route short enough to be cached
+static const linkaddr_t *hit_dest;
+static unsigned max_depth = ROUTING_TABLE_MAX_ROUTE_LENGTH;
+static double min_time = 0.02;
+static uint64_t rng_state = 88172645463325252ULL;
+
+static struct result baseline[MAX_BASELINE];
+static int baseline_count = 0;
+
+// Heap allocations of the code under test (see the --wrap linker options in the Makefile)
+static uint64_t allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  allocations++;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+
+/* Trees ------------------------------------------------------------------------------*/
+
+static uint64_t rng_next() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static inline void node_addr(unsigned id, linkaddr_t *addr) {
+  addr->u8[0] = id & 0xFF;
+  addr->u8[1] = id >> 8;
+}
+
+// Build the tree of "nodes" nodes (sink included). Return its depth
+static unsigned tree_create(enum shape shape, unsigned nodes) {
+  unsigned *depth = calloc(nodes, sizeof(unsigned));
+  unsigned max = 0;
+  unsigned i;
+
+  for (i = 1; i < nodes; i++) {
+    unsigned parent = 0;
+
+    switch (shape) {
+      case SHAPE_LINE: // Node i is in chain (i - 1) / max_depth
+        parent = (i - 1) % max_depth == 0 ? 0 : i - 1;
+        break;
+      case SHAPE_STAR:
+        parent = 0;
+        break;
+      case SHAPE_BALANCED:
+        parent = (i - 1) / 2;
+        break;
+      case SHAPE_RANDOM:
+        parent = rng_next() % i;
+        break;
+      default:
+        break;
+    }
+    if (depth[parent] + 1 > max_depth) { // Keep routes within the max route length
+      parent = 0;
+    }
+
+    node_addr(parent + 1, &parents[i]);
+    depth[i] = depth[parent] + 1;
+    if (depth[i] > max) {
+      max = depth[i];
+    }
+  }
+
+  for (i = 0; i < DESTS_COUNT; i++) {
+    node_addr(2 + rng_next() % (nodes - 1), &dests[i]);
+  }
+
+  free(depth);
+  return max;
+}
+
+static void table_fill(unsigned nodes) {
+  linkaddr_t child;
+  unsigned i;
+
+  routing_table_init(&table);
+  for (i = 1; i < nodes; i++) {
+    node_addr(i + 1, &child);
+    routing_table_update_entry(&table, &parents[i], &child);
+  }
+
+  // A cache hit needs a route that fits the cache (the first destination of a line is not cached)
+  hit_dest = &dests[0];
+  for (i = 0; i < DESTS_COUNT; i++) {
+    int length = routing_table_route_length(&table, &dests[i]);
+    if (length > 0 && length <= ROUTE_CACHE_MAX_LENGTH) {
+      hit_dest = &dests[i];
+      break;
+    }
+  }
+}
+
+
+/* Measures ---------------------------------------------------------------------------*/
+
+static inline double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Run a batch of the operation. Return the number of operations and add the time spent to "elapsed"
+static uint64_t op_batch(enum op op, unsigned nodes, double *elapsed) {
+  static linkaddr_t route[ROUTING_TABLE_MAX_ROUTE_LENGTH];
+  volatile int sink = 0;
+  linkaddr_t child;
+  double start;
+  unsigned i, rep;
+  // Passes over the nodes or the destinations timed by a single clock read
+  unsigned node_reps = (BATCH_OPS + nodes - 2) / (nodes - 1);
+  unsigned dest_reps = BATCH_OPS / DESTS_COUNT;
+
+  switch (op) {
+    case OP_INSERT:
+      // The table must be emptied before every pass (not measured): one pass per clock read
+      routing_table_init(&table);
+      start = now();
+      for (i = 1; i < nodes; i++) {
+        node_addr(i + 1, &child);
+        sink += routing_table_update_entry(&table, &parents[i], &child);
+      }
+      *elapsed += now() - start;
+      return nodes - 1;
+
+    case OP_UPDATE:
+      start = now();
+      for (rep = 0; rep < node_reps; rep++) {
+        for (i = 1; i < nodes; i++) {
+          node_addr(i + 1, &child);
+          sink += routing_table_update_entry(&table, &parents[i], &child);
+        }
+      }
+      *elapsed += now() - start;
+      return (uint64_t)node_reps * (nodes - 1);
+
+    case OP_GET_PARENT:
+      start = now();
+      for (rep = 0; rep < dest_reps; rep++) {
+        for (i = 0; i < DESTS_COUNT; i++) {
+          sink += routing_table_get_parent(&table, dests[i]).u16;
+        }
+      }
+      *elapsed += now() - start;
+      return (uint64_t)dest_reps * DESTS_COUNT;
+
+    case OP_ROUTE:
+    case OP_ROUTE_HIT:
+      start = now();
+      for (rep = 0; rep < dest_reps; rep++) {
+        for (i = 0; i < DESTS_COUNT; i++) {
+          const linkaddr_t *dest = op == OP_ROUTE ? &dests[i] : hit_dest;
+          int length = routing_table_route_length(&table, dest);
+          sink += routing_table_find_route_path(&table, dest, route, length, PATH_ENTRY_SIZE_FULL);
+        }
+      }
+      *elapsed += now() - start;
+      return (uint64_t)dest_reps * DESTS_COUNT;
+
+    default:
+      return 0;
+  }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Fastest of MEASURE_RUNS runs of at least "min_time" seconds each (or 10 times that including the setup of the batches)
+static void op_measure(enum op op, unsigned nodes, struct result *result) {
+  double times[MEASURE_RUNS];
+  uint64_t max_allocs = 0;
+  int run;
+
+  table_fill(nodes);
+  result->allocs_per_op = 0;
+  for (run = 0; run < MEASURE_RUNS; run++) {
+    double elapsed = 0;
+    double start = now();
+    uint64_t ops = 0;
+    uint64_t allocs = allocations;
+
+    while (elapsed < min_time && (ops == 0 || now() - start < 10 * min_time)) {
+      ops += op_batch(op, nodes, &elapsed);
+    }
+    times[run] = elapsed * 1e9 / ops;
+    if (allocations - allocs > max_allocs) {
+      max_allocs = allocations - allocs;
+      result->allocs_per_op = (double)max_allocs / ops;
+    }
+  }
+
+  qsort(times, MEASURE_RUNS, sizeof(double), compare_doubles);
+  result->ns_per_op = times[0];
+}
+
+
+// Return the time of an iteration of a fixed loop (ns), fastest of MEASURE_RUNS runs
+static double calibrate() {
+  volatile uint64_t sink;
+  double times[MEASURE_RUNS];
+  int run, i;
+
+  for (run = 0; run < MEASURE_RUNS; run++) {
+    uint64_t x = 1;
+    double start = now();
+    for (i = 0; i < CALIBRATION_LOOPS; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+    }
+    sink = x;
+    times[run] = (now() - start) * 1e9 / CALIBRATION_LOOPS;
+  }
+  (void)sink;
+
+  qsort(times, MEASURE_RUNS, sizeof(double), compare_doubles);
+  return times[0];
+}
+
+
+/* Baseline ---------------------------------------------------------------------------*/
+
+// Read a baseline file (lines: <shape> <nodes> <op> <ns/op> <allocs/op>, "#" for comments)
+static bool baseline_read(const char *file) {
+  FILE *f = fopen(file, "r");
+  char line[256];
+
+  if (f == NULL) {
+    return false;
+  }
+  while (fgets(line, sizeof(line), f) != NULL && baseline_count < MAX_BASELINE) {
+    struct result *r = &baseline[baseline_count];
+    if (line[0] != '#' && sscanf(line, "%15s %u %15s %lf %lf", r->shape, &r->nodes, r->op,
+        &r->ns_per_op, &r->allocs_per_op) == 5) {
+      baseline_count++;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static const struct result* baseline_find(const struct result *result) {
+  int i;
+
+  for (i = 0; i < baseline_count; i++) {
+    if (baseline[i].nodes == result->nodes && strcmp(baseline[i].shape, result->shape) == 0 &&
+        strcmp(baseline[i].op, result->op) == 0) {
+      return &baseline[i];
+    }
+  }
+  return NULL;
+}
+
+
+/* Main -------------------------------------------------------------------------------*/
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -n <n,n,...>      number of nodes of the trees, sink included (default: 10,100,1000,10000,65535)\n"
+    "  -s <shape,...>    line, star, balanced, random (default: all)\n"
+    "  -d <depth>        max depth of the trees (default and max: %d)\n"
+    "  -m <ms>           min time of a measure (default: 20)\n"
+    "  -b <file>         compare with the baseline file (exit status 1 on regressions)\n"
+    "  -t <percent>      slowdown over the baseline considered a regression (default: 50)\n"
+    "  -f <ns>           noise floor: slowdowns of less than this are never regressions (default: 15)\n"
+    "  -w <file>         write the results as a baseline file\n",
+    name, ROUTING_TABLE_MAX_ROUTE_LENGTH);
+}
+
+int main(int argc, char **argv) {
+  unsigned sizes[MAX_SIZES] = {10, 100, 1000, 10000, 65535};
+  int sizes_count = 5;
+  bool shapes[SHAPE_COUNT] = {true, true, true, true};
+  const char *baseline_file = NULL;
+  const char *output_file = NULL;
+  double threshold = 50;
+  double noise_floor = 15;
+  FILE *output = NULL;
+  int regressions = 0;
+  int opt, s, i, o;
+  char *token;
+
+  while ((opt = getopt(argc, argv, "n:s:d:m:b:t:f:w:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        sizes_count = 0;
+        for (token = strtok(optarg, ","); token != NULL && sizes_count < MAX_SIZES; token = strtok(NULL, ",")) {
+          sizes[sizes_count++] = strtoul(token, NULL, 10);
+        }
+        break;
+      case 's':
+        memset(shapes, 0, sizeof(shapes));
+        for (token = strtok(optarg, ","); token != NULL; token = strtok(NULL, ",")) {
+          for (s = 0; s < SHAPE_COUNT && strcmp(token, shape_names[s]) != 0; s++);
+          if (s == SHAPE_COUNT) {
+            usage(argv[0]);
+            return 2;
+          }
+          shapes[s] = true;
+        }
+        break;
+      case 'd': max_depth = strtoul(optarg, NULL, 10); break;
+      case 'm': min_time = atof(optarg) / 1000; break;
+      case 'b': baseline_file = optarg; break;
+      case 't': threshold = atof(optarg); break;
+      case 'f': noise_floor = atof(optarg); break;
+      case 'w': output_file = optarg; break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  if (max_depth == 0 || max_depth > ROUTING_TABLE_MAX_ROUTE_LENGTH) {
+    usage(argv[0]);
+    return 2;
+  }
+  for (i = 0; i < sizes_count; i++) {
+    // Node ids are 16-bit addresses (0 is "linkaddr_null"), children must fit in the table
+    if (sizes[i] < 2 || sizes[i] > 0xFFFF || sizes[i] - 1 > ROUTING_TABLE_SIZE) {
+      fprintf(stderr, "Invalid number of nodes: %u (2 to %u with ROUTING_TABLE_SIZE %u)\n",
+        sizes[i], ROUTING_TABLE_SIZE + 1 < 0xFFFF ? ROUTING_TABLE_SIZE + 1 : 0xFFFF, ROUTING_TABLE_SIZE);
+      return 2;
+    }
+  }
+  if (baseline_file != NULL && !baseline_read(baseline_file)) {
+    fprintf(stderr, "Cannot read the baseline file %s\n", baseline_file);
+    return 2;
+  }
+  if (output_file != NULL) {
+    output = fopen(output_file, "w");
+    if (output == NULL) {
+      fprintf(stderr, "Cannot write the baseline file %s\n", output_file);
+      return 2;
+    }
+    fprintf(output, "# <shape> <nodes> <op> <ns/op> <allocs/op> (ROUTING_TABLE_SIZE %u, ROUTE_CACHE_SIZE %u)\n",
+      ROUTING_TABLE_SIZE, ROUTE_CACHE_SIZE);
+  }
+
+  struct result calibration = {.shape = "calibration", .nodes = 0, .op = "loop", .ns_per_op = calibrate()};
+  const struct result *base_calibration = baseline_find(&calibration);
+  // Baseline times are scaled by the speed of this run
+  double scale = base_calibration != NULL ? calibration.ns_per_op / base_calibration->ns_per_op : 1;
+
+  printf("Calibration: %.3f ns/loop", calibration.ns_per_op);
+  if (base_calibration != NULL) {
+    printf(" (baseline times scaled by %.2f)", scale);
+  }
+  printf("\n");
+  if (output != NULL) {
+    fprintf(output, "%s %u %s %.3f %.2f\n", calibration.shape, calibration.nodes, calibration.op,
+      calibration.ns_per_op, calibration.allocs_per_op);
+  }
+
+  // The routing table walks routes up to the current node (the sink)
+  node_addr(SINK_ID, &linkaddr_node_addr);
+  parents = calloc(0x10000, sizeof(linkaddr_t));
+
+  printf("%-9s %6s %5s  %-10s %10s %10s  %s\n", "shape", "nodes", "depth", "op", "ns/op", "allocs/op", "baseline");
+  for (s = 0; s < SHAPE_COUNT; s++) {
+    if (!shapes[s]) {
+      continue;
+    }
+    for (i = 0; i < sizes_count; i++) {
+      unsigned depth = tree_create(s, sizes[i]);
+
+      for (o = 0; o < OP_COUNT; o++) {
+        struct result result = {.nodes = sizes[i]};
+        const struct result *base;
+
+        strcpy(result.shape, shape_names[s]);
+        strcpy(result.op, op_names[o]);
+        op_measure(o, sizes[i], &result);
+
+        printf("%-9s %6u %5u  %-10s %10.1f %10.2f", result.shape, result.nodes, depth, result.op,
+          result.ns_per_op, result.allocs_per_op);
+        base = baseline_find(&result);
+        if (base != NULL) {
+          double expected = base->ns_per_op * scale;
+          double change = 100 * (result.ns_per_op - expected) / expected;
+          bool regression = (change > threshold && result.ns_per_op - expected > noise_floor) ||
+            result.allocs_per_op > base->allocs_per_op;
+          printf("  %+6.1f%%%s", change, regression ? "  REGRESSION" : "");
+          regressions += regression;
+        }
+        printf("\n");
+
+        if (output != NULL) {
+          fprintf(output, "%s %u %s %.1f %.2f\n", result.shape, result.nodes, result.op,
+            result.ns_per_op, result.allocs_per_op);
+        }
+      }
+    }
+  }
+
+  if (output != NULL) {
+    fclose(output);
+  }
+  free(parents);
+
+  if (baseline_file != NULL) {
+    printf("%d regression(s) against %s (threshold %.0f%%, noise floor %.1f ns)\n", regressions, baseline_file,
+      threshold, noise_floor);
+  }
+  return regressions > 0 ? 1 : 0;
+}
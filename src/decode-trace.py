@@ -0,0 +1,93 @@
+#!/usr/bin/env python2.7
+
+# Decode the binary trace records (MY_TRACE_CONF_BINARY=1) of a Cooja log into the text format
+# printed by the nodes in text mode. Lines without records are copied unchanged.
+#
+# Usage: decode-trace.py [-t] <log file> [<events catalog> (default: my_trace_events.h)]
+#   -t: write the clock time of every record (in ticks) before its text
+
+from __future__ import division, print_function
+
+import argparse
+import codecs
+import re
+import sys
+import os.path
+
+# Prefix of the lines with records (see MY_TRACE_LINE_PREFIX)
+line_prefix = "#T"
+
+def parse_events(catalog_file):
+	# Event ids are the positions in the catalog
+	regex_event = re.compile(r'^MY_TRACE_EVENT\((?P<name>\w+),\s*(?P<level>\w+),\s*"(?P<format>(?:[^"\\]|\\.)*)"\)')
+	events = []
+
+	with open(catalog_file, 'r') as f:
+		for line in f:
+			m = regex_event.match(line)
+			if m:
+				fmt = codecs.decode(m.group("format"), "unicode_escape").rstrip("\n")
+				events.append((m.group("name"), fmt))
+
+	return events
+
+def format_record(events, event, args):
+	if event >= len(events):
+		return "<trace> <ERROR> Unknown event {} (args: {})".format(event, args)
+
+	name, fmt = events[event]
+	conversions = re.findall(r'%[-0-9]*([a-z])', fmt)
+	if len(conversions) != len(args):
+		return "<trace> <ERROR> Event {} has {} args instead of {}".format(name, len(args), len(conversions))
+
+	# Arguments are stored as 16-bit values: restore the sign of the signed ones
+	values = []
+	for conversion, arg in zip(conversions, args):
+		if conversion in "di" and arg >= 0x8000:
+			arg -= 0x10000
+		values.append(arg)
+
+	return fmt % tuple(values)
+
+def decode_token(events, token):
+	# <event (2 hex digits), timestamp (4), args (4 each)>
+	event = int(token[0:2], 16)
+	timestamp = int(token[2:6], 16)
+	args = [int(token[i:i + 4], 16) for i in range(6, len(token), 4)]
+	return timestamp, format_record(events, event, args)
+
+def decode_file(log_file, events, ticks):
+	with open(log_file, 'r') as f:
+		for line in f:
+			line = line.rstrip("\n")
+			index = line.find(line_prefix + " ")
+
+			if index < 0:
+				print(line)
+				continue
+
+			# Records are printed with the prefix (time and node id) of the line that contains them
+			prefix = line[:index]
+			for token in line[index + len(line_prefix):].split():
+				try:
+					timestamp, text = decode_token(events, token)
+				except ValueError:
+					timestamp = "?"
+					text = "<trace> <ERROR> Malformed record {}".format(token)
+				if ticks:
+					text = "[{}] {}".format(timestamp, text)
+				print(prefix + text)
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description="Decode the binary trace records of a log")
+	parser.add_argument("-t", dest="ticks", action="store_true", help="write the clock time of every record")
+	parser.add_argument("log_file")
+	parser.add_argument("catalog_file", nargs="?",
+		default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "my_trace_events.h"))
+	args = parser.parse_args()
+
+	if not os.path.isfile(args.log_file) or not os.path.isfile(args.catalog_file):
+		print("Error: file not found")
+		sys.exit(1)
+
+	decode_file(args.log_file, parse_events(args.catalog_file), args.ticks)
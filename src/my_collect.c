@@ -1,4 +1,3 @@
-#include <stdlib.h>
 #include <stdbool.h>
 #include "contiki.h"
 #include "lib/random.h"
@@ -8,6 +7,7 @@
 #include <stdio.h>
 #include "core/net/linkaddr.h"
 #include "my_collect.h"
+#include "my_trace.h"
 #include "my_routing_table.h"
 
 #define BEACON_INTERVAL (CLOCK_SECOND*60)
@@ -15,67 +15,347 @@
 #define MAX_PATH_LENGTH 10
 
 #define RSSI_THRESHOLD -95
+#define ROUTE_REQUEST_FORWARD_DELAY (random_rand() % (CLOCK_SECOND / 8))
 
 /* Forward declarations */
 void bc_recv(struct broadcast_conn *conn, const linkaddr_t *sender);
 void uc_recv(struct unicast_conn *c, const linkaddr_t *from);
+void uc_sent(struct unicast_conn *c, int status, int num_tx);
 void beacon_timer_cb(void* ptr);
+static void handle_recv_batch_packet(struct my_collect_conn *conn, struct collect_header *hdr, const linkaddr_t *from);
+static bool choose_parent(struct my_collect_conn *conn);
+static int queue_send(struct my_collect_conn *conn, const linkaddr_t *next_hop);
+static void queue_sent(struct my_collect_conn *conn, int status);
+static void queue_transmit_head(struct my_collect_conn *conn);
+#if MY_COLLECT_STATS_REPORT
+static void stats_timer_cb(void *ptr);
+#endif
+#if ROUTING_TABLE_EXPORT
+static void snapshot_timer_cb(void *ptr);
+#endif
+#if MY_COLLECT_STAGGER
+#if MY_COLLECT_BATCHING
+static void batch_flush_cb(void *ptr);
+#endif
+#endif
+#if MY_COLLECT_REPORT_CONTROL
+static clock_time_t report_delay(struct my_collect_conn *conn, clock_time_t delay);
+static void report_suppress(struct my_collect_conn *conn);
+static void report_control_update(struct my_collect_conn *conn, uint8_t period, uint8_t burst);
+#endif
+#if MY_COLLECT_ROUTE_DISCOVERY
+static void rreq_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender);
+static void rreq_timer_cb(void *ptr);
+static bool rreq_start(struct my_collect_conn *conn, const linkaddr_t *dest);
+static void rreq_heard(struct my_collect_conn *conn, const linkaddr_t *source);
+#endif
 /* Callback structures */
 struct broadcast_callbacks bc_cb = {.recv=bc_recv};
-struct unicast_callbacks uc_cb = {.recv=uc_recv};
+struct unicast_callbacks uc_cb = {.recv=uc_recv, .sent=uc_sent};
+#if MY_COLLECT_ROUTE_DISCOVERY
+struct broadcast_callbacks rreq_cb = {.recv=rreq_recv};
+#endif
 
-bool is_the_sink = false;
-struct ctimer dedicated_topology_report_timer;
+
+/* Return the size of the entries of the path array attached to the header */
+static inline uint8_t header_entry_size(const struct collect_header *hdr) {
+  return (hdr->flags & COLLECT_FLAG_COMPACT_PATH) ? PATH_ENTRY_SIZE_COMPACT : PATH_ENTRY_SIZE_FULL;
+}
 
 /*--------------------------------------------------------------------------------------*/
-void my_collect_open(struct my_collect_conn* conn, uint16_t channels, bool is_sink, const struct my_collect_callbacks *callbacks) {
+void my_collect_open(struct my_collect_conn* conn, uint16_t channels, bool is_sink,
+  struct routing_table *routing_table, const struct my_collect_callbacks *callbacks) {
+  int i = 0;
+
+  my_trace_init();
+
+  if (is_sink && routing_table == NULL) {
+    TRACE(TRACE_OPEN_NO_ROUTING_TABLE);
+    return;
+  }
+  conn->routing_table = routing_table;
+
   // initialise the connector structure
   linkaddr_copy(&conn->parent, &linkaddr_null);
   conn->metric = 65535; // the max metric (means that the node is not connected yet)
   conn->beacon_seqn = 0;
+  conn->topology_epoch = 0;
+  conn->path_etx = ETX_MAX;
+  conn->beacon_counter = 0;
+  neighbor_table_init(&conn->neighbors);
+  conn->packet_seqn = random_rand(); // Avoid reusing the seqns of the packets sent before a reboot
+  for (i = 0; i < MY_COLLECT_DUPLICATE_CACHE_SIZE; i++) {
+    linkaddr_copy(&conn->recent_packets[i].source, &linkaddr_null);
+  }
+  conn->recent_packets_next = 0;
+  my_collect_stats_reset(conn);
+#if MY_COLLECT_LATENCY
+  memset(&conn->latency, 0, sizeof(struct my_collect_latency));
+#endif
+  conn->queue_head = 0;
+  conn->queue_length = 0;
   conn->callbacks = callbacks;
+  conn->trickle_interval = MY_COLLECT_TRICKLE_IMIN;
+  conn->trickle_counter = 0;
+#if MY_COLLECT_BATCHING
+  conn->batch_length = 0;
+#endif
+#if MY_COLLECT_STAGGER
+  conn->stagger_synced = false;
+  conn->stagger_listening = false;
+  conn->stagger_held = false;
+  conn->stagger_idle_cycles = MY_COLLECT_STAGGER_IDLE_CYCLES;
+#endif
+#if MY_COLLECT_REPORT_CONTROL
+  conn->report_period = MY_COLLECT_REPORT_PERIOD;
+  conn->report_burst = MY_COLLECT_REPORT_BURST;
+  conn->report_tokens = MY_COLLECT_REPORT_BURST;
+  conn->report_refill_time = clock_time();
+  conn->report_backoff = 0;
+  conn->report_last_change = clock_time() - MY_COLLECT_REPORT_CHURN_WINDOW; // First parent is not churn
+#endif
+#if MY_COLLECT_ROUTE_DISCOVERY
+  conn->rreq_seqn = 0;
+  conn->rreq_heard = false;
+  linkaddr_copy(&conn->rreq_target, &linkaddr_null);
+  linkaddr_copy(&conn->pending_dest, &linkaddr_null);
+#endif
 
   // open the underlying primitives
   broadcast_open(&conn->bc, channels,     &bc_cb);
   unicast_open  (&conn->uc, channels + 1, &uc_cb);
+#if MY_COLLECT_ROUTE_DISCOVERY
+  broadcast_open(&conn->rreq_bc, channels + 2, &rreq_cb);
+#endif
 
   // TASK 1: make the sink send beacons periodically
 
   // Save is_sink value (used in on_recv callback)
-  is_the_sink = is_sink;
+  conn->is_sink = is_sink;
 
   // Sink ///////////////////////////////////////
-  if (is_the_sink) { // Only if the node is the sink, otherwise everybody starts sending stuff
+  if (conn->is_sink) { // Only if the node is the sink, otherwise everybody starts sending stuff
     initialize_sink(conn);
   }
 
-  printf("<open> Node is %u.\n", linkaddr_node_addr.u16);
+#if MY_COLLECT_STATS_REPORT
+  conn->stats_report_pending = false;
+  if (!conn->is_sink) {
+    ctimer_set(&conn->stats_timer, MY_COLLECT_STATS_REPORT_INTERVAL, stats_timer_cb, conn);
+  }
+#endif
+
+  TRACE(TRACE_OPEN_NODE, linkaddr_node_addr.u16);
+}
+
+/* Staggered slots --------------------------------------------------------------------*/
+
+#if MY_COLLECT_STAGGER
+// Cycle phase advertised in the beacons of a node not synced yet
+#define STAGGER_PHASE_UNKNOWN 0xFFFF
+
+// Current phase in the cycle (advances the start of the cycle if needed)
+static clock_time_t stagger_phase(struct my_collect_conn *conn) {
+  clock_time_t now = clock_time();
+
+  while ((clock_time_t)(now - conn->stagger_cycle_start) >= MY_COLLECT_STAGGER_PERIOD) {
+    conn->stagger_cycle_start += MY_COLLECT_STAGGER_PERIOD;
+    if (conn->stagger_idle_cycles < 255) {
+      conn->stagger_idle_cycles++;
+    }
+  }
+  return now - conn->stagger_cycle_start;
+}
+
+// Slot of the node in the cycle: deeper nodes send first (slot 0: MY_COLLECT_STAGGER_MAX_DEPTH and deeper)
+static inline clock_time_t stagger_slot_start(const struct my_collect_conn *conn) {
+  uint16_t depth = conn->metric < MY_COLLECT_STAGGER_MAX_DEPTH ? conn->metric : MY_COLLECT_STAGGER_MAX_DEPTH;
+  return (MY_COLLECT_STAGGER_MAX_DEPTH - depth) * MY_COLLECT_STAGGER_SLOT;
+}
+
+// True if the node can send upward packets now
+static bool stagger_may_send(struct my_collect_conn *conn) {
+  if (!conn->stagger_synced) {
+    return true; // No cycle yet -> send as without slots
+  }
+  clock_time_t phase = stagger_phase(conn);
+  clock_time_t slot = stagger_slot_start(conn);
+  return phase >= slot && phase < slot + MY_COLLECT_STAGGER_SLOT;
+}
+
+static void stagger_timer_cb(void *ptr);
+
+/**
+ * Apply the state of the current phase of the cycle (radio, packets held for the slot) and
+ * schedule the next slot boundary: [children slot: listen] [own slot: listen and send].
+ */
+static void stagger_schedule(struct my_collect_conn *conn) {
+  clock_time_t phase = stagger_phase(conn);
+  clock_time_t slot = stagger_slot_start(conn);
+  // Nodes of slot 0 have no slot of children before their own (deeper children share it)
+  clock_time_t listen_start = slot > 0 ? slot - MY_COLLECT_STAGGER_SLOT : 0;
+  clock_time_t slot_end = slot + MY_COLLECT_STAGGER_SLOT;
+  bool listen = phase >= listen_start && phase < slot_end &&
+    conn->stagger_idle_cycles < MY_COLLECT_STAGGER_IDLE_CYCLES;
+
+  if (listen != conn->stagger_listening) {
+    // Keep the radio on (duty cycling off) in the slots of the children.
+    // NB: not reference counted, one connection per node drives the RDC (see MY_COLLECT_STAGGER)
+    if (listen) {
+      NETSTACK_RDC.off(1);
+    } else {
+      NETSTACK_RDC.on();
+    }
+    conn->stagger_listening = listen;
+    TRACE(TRACE_STAGGER_LISTEN, listen);
+  }
+
+  clock_time_t next = phase < listen_start ? listen_start :
+    phase < slot ? slot :
+    phase < slot_end ? slot_end : MY_COLLECT_STAGGER_PERIOD;
+  ctimer_set(&conn->stagger_timer, next - phase, stagger_timer_cb, conn);
+
+  if (phase >= slot && phase < slot_end) {
+#if MY_COLLECT_BATCHING
+    // Forwarded packets of the children (received in the previous slot) leave in this one
+    batch_flush_cb(conn);
+#endif
+    if (conn->stagger_held) {
+      conn->stagger_held = false;
+      queue_transmit_head(conn);
+    }
+  }
+}
+
+static void stagger_timer_cb(void *ptr) {
+  stagger_schedule((struct my_collect_conn *)ptr);
+}
+
+// Align the cycle to the phase advertised by the parent
+static void stagger_sync(struct my_collect_conn *conn, uint16_t phase) {
+  if (phase >= MY_COLLECT_STAGGER_PERIOD) {
+    return;
+  }
+  if (!conn->stagger_synced) {
+    TRACE(TRACE_STAGGER_SYNCED, conn->parent.u8[0], conn->parent.u8[1], phase, stagger_slot_start(conn));
+  }
+  conn->stagger_cycle_start = clock_time() - phase;
+  conn->stagger_synced = true;
+  stagger_schedule(conn);
+}
+
+// Phase advertised in the beacons
+static uint16_t stagger_beacon_phase(struct my_collect_conn *conn) {
+  return conn->stagger_synced ? stagger_phase(conn) : STAGGER_PHASE_UNKNOWN;
 }
+#endif
+
 
 /* Handling beacons --------------------------------------------------------------------*/
 
 struct beacon_msg { // Beacon message structure
   uint16_t seqn;
   uint16_t metric;
+  // Cumulative ETX of the path to the sink
+  uint16_t path_etx;
+  // Parent of the sender (a node never fails over to its own children)
+  linkaddr_t parent;
+  // Per-sender counter of the beacons sent
+  uint8_t counter;
+#if MY_COLLECT_STAGGER
+  // Phase of the sender in the cycle of the staggered slots (STAGGER_PHASE_UNKNOWN if not synced)
+  uint16_t cycle_phase;
+#endif
+#if MY_COLLECT_REPORT_CONTROL
+  // Token bucket of the topology reports set by the sink (see my_collect_report_control_set())
+  uint8_t report_period;
+  uint8_t report_burst;
+#endif
 } __attribute__((packed));
 
 // Send beacon using the current seqn and metric
 void send_beacon(struct my_collect_conn* conn) {
-  struct beacon_msg beacon = {.seqn = conn->beacon_seqn, .metric = conn->metric};
+  struct beacon_msg beacon = {.seqn = conn->beacon_seqn, .metric = conn->metric, .path_etx = conn->path_etx,
+    .parent = conn->parent, .counter = ++conn->beacon_counter};
+#if MY_COLLECT_STAGGER
+  beacon.cycle_phase = stagger_beacon_phase(conn);
+#endif
+#if MY_COLLECT_REPORT_CONTROL
+  beacon.report_period = conn->report_period;
+  beacon.report_burst = conn->report_burst;
+#endif
 
   packetbuf_clear();
   packetbuf_copyfrom(&beacon, sizeof(beacon));
   broadcast_send(&conn->bc);
-  printf("<out> <beacon> Beacon sent in broadcast (seqn: %d, metric: %d)\n", conn->beacon_seqn, conn->metric);
+  conn->stats.beacons_sent++;
+  TRACE(TRACE_BEACON_SENT, conn->beacon_seqn, conn->metric, conn->path_etx);
 }
 
-void send_beacon_cb(void* ptr) {
-  // Cast param
+/* Trickle ----------------------------------------------------------------------------*/
+
+static void trickle_interval_end_cb(void *ptr);
+
+// Send the beacon of the current interval, unless enough consistent beacons have been heard
+static void trickle_fire_cb(void *ptr) {
   struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
-  send_beacon(conn);
+
+  if (conn->trickle_counter < MY_COLLECT_TRICKLE_K) {
+    send_beacon(conn);
+  } else {
+    TRACE(TRACE_BEACON_SUPPRESSED, conn->trickle_counter);
+  }
+  TRACE(TRACE_TRICKLE_INTERVAL, conn->trickle_interval / CLOCK_SECOND);
+
+  ctimer_set(&conn->trickle_timer, conn->trickle_interval - conn->trickle_t, trickle_interval_end_cb, conn);
+}
+
+// Start a new interval: the beacon is sent at a random time in [I/2, I)
+static void trickle_start_interval(struct my_collect_conn *conn) {
+  conn->trickle_counter = 0;
+  conn->trickle_t = (conn->trickle_interval / 2) + (random_rand() % (conn->trickle_interval / 2));
+  ctimer_set(&conn->trickle_timer, conn->trickle_t, trickle_fire_cb, conn);
+}
+
+// End of the interval without inconsistencies -> double the interval
+static void trickle_interval_end_cb(void *ptr) {
+  struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
+
+  if (conn->trickle_interval < MY_COLLECT_TRICKLE_IMAX / 2) {
+    conn->trickle_interval *= 2;
+  } else {
+    conn->trickle_interval = MY_COLLECT_TRICKLE_IMAX;
+  }
+  trickle_start_interval(conn);
+}
+
+// Inconsistency (new seqn, metric or parent change, stale neighbor) -> beacon soon
+static void trickle_reset(struct my_collect_conn *conn) {
+  if (conn->trickle_interval == MY_COLLECT_TRICKLE_IMIN && !ctimer_expired(&conn->trickle_timer)) {
+    return; // Already at the shortest interval -> a beacon is coming anyway
+  }
+  conn->trickle_interval = MY_COLLECT_TRICKLE_IMIN;
+  trickle_start_interval(conn);
+}
+
+// Consistent beacon heard
+static void trickle_consistent(struct my_collect_conn *conn) {
+  if (conn->trickle_counter < 255) {
+    conn->trickle_counter++;
+  }
+}
+
+// Forward the seqn of a new round (nodes use the beacon timer of the sink for it)
+static void beacon_forward_cb(void *ptr) {
+  send_beacon((struct my_collect_conn *)ptr);
 }
 
-// Beacon timer callback
+// True if seqn is the round after current_seqn (with wrapping)
+static inline bool seqn_is_next_round(uint16_t seqn, uint16_t current_seqn) {
+  return (uint16_t)(seqn - current_seqn) == 1;
+}
+
+// Beacon timer callback (sink only)
 void beacon_timer_cb(void* ptr) { // ptr is the connection (my_collect_conn* conn)
   // TASK 2: implement the beacon callback
 
@@ -83,12 +363,25 @@ void beacon_timer_cb(void* ptr) { // ptr is the connection (my_collect_conn* con
   struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
   // sink send new beacon -> increment the beacon seq num
   conn->beacon_seqn = conn->beacon_seqn + 1;
-  // Send beacon
+  // Free the pairs of the nodes not heard for a while (dead or moved away)
+  routing_table_expire(conn->routing_table);
+  // Periodic refresh, not an inconsistency: the new seqn is flooded once (every node forwards it)
+  // and trickle keeps its interval, so a stable tree reaches MY_COLLECT_TRICKLE_IMAX
   send_beacon(conn);
   // Restart timer
   ctimer_reset(&conn->beacon_timer);
 }
 
+#if ROUTING_TABLE_EXPORT
+// Snapshot timer callback (sink only): full state of the tree, changes in between are traced by the table
+static void snapshot_timer_cb(void *ptr) {
+  struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
+
+  routing_table_snapshot(conn->routing_table);
+  ctimer_reset(&conn->snapshot_timer);
+}
+#endif
+
 // Beacon receive callback
 void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender) {
   struct beacon_msg beacon;
@@ -97,76 +390,165 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender) {
   struct my_collect_conn* conn = (struct my_collect_conn*)(((uint8_t*)bc_conn) - offsetof(struct my_collect_conn, bc));
 
   if (packetbuf_datalen() != sizeof(struct beacon_msg)) {
-    printf("<in_> <beacon> Beacon received but with the wrong size\n");
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_BEACON_WRONG_SIZE);
     return;
   }
+  conn->stats.beacons_received++;
 
   memcpy(&beacon, packetbuf_dataptr(), sizeof(struct beacon_msg));
   rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
-  printf("<in_> <beacon> Beacon received from: %02x:%02x (seqn: %u, metric: %u, rssi %d)\n",
-    sender->u8[0], sender->u8[1], beacon.seqn, beacon.metric, rssi);
+  TRACE(TRACE_BEACON_RECEIVED,
+    sender->u8[0], sender->u8[1], beacon.seqn, beacon.metric, beacon.path_etx, rssi);
 
   // TASK 3: analyse the received beacon, update the routing info (parent, metric), if needed
   // TASK 4: retransmit the beacon if the metric or the seqn has been updated
 
   // Check seqn:
-  // - (seqn > current seqn) -> update parent (without considering metric because it is a fresher beacon)
-  // - (seqn < current seqn) -> old beacon, ignore it
-  // - (seqn = current seqn) -> check if current beacon has better metric:
-  //   - (metric < current metric)          -> update parent
-  //   - (metric >= current metric)         -> ignore beacon
-  //   - (metric = current parent's metric) -> check RSSI to decide if update parent is convenient
+  // - (seqn > current seqn) -> new beacon round: adopt the seqn and spread it (forwarded once if it
+  //   is the next round, trickle reset if the node was further behind)
+  // - (seqn < current seqn) -> old beacon, ignore it (beacon soon to refresh the sender, unless it
+  //   is just one round behind: the round is still spreading and the sender will hear it)
+  // In both the new and current round, choose the neighbor with the best path cost (path ETX + link ETX)
+  // among the ones with recent info (current or previous round), switching parent only if it is clearly better
+
+  if (conn->is_sink) {
+    // Sink never changes its parent: only check if the sender is up to date
+    if (beacon.seqn == conn->beacon_seqn) {
+      trickle_consistent(conn);
+    } else if (!seqn_is_next_round(conn->beacon_seqn, beacon.seqn)) {
+      trickle_reset(conn);
+    }
+    return;
+  }
 
   if (rssi > RSSI_THRESHOLD) { // Discard beacon if rssi value is poor
 
+    // Update link estimation and advertised info of the sender
+    linkaddr_t beacon_parent = beacon.parent; // Aligned copy
+    neighbor_table_update_beacon(&conn->neighbors, sender, rssi, beacon.counter,
+      beacon.seqn, beacon.metric, beacon.path_etx, &beacon_parent, &conn->parent);
+
     if (beacon.seqn > conn->beacon_seqn) {
       // Beacon has higher seqn than every beacon already seen
+      bool next_round = seqn_is_next_round(beacon.seqn, conn->beacon_seqn);
 
       // Update current beacon seqn with the newest
       conn->beacon_seqn = beacon.seqn;
 
-      // Current beacon if "fresher" than the last seen -> do not take into account metric and update parent directly
-      // (eg: if node has been moved, around topology is completely changed and metric is meaningless)
-      update_node_parent(conn, beacon.metric, sender, rssi); // Update current parent
+      // The sender is the first neighbor heard in the new round, not necessarily the best one: the parent
+      // is chosen on path cost among the neighbors heard in this round and the previous one
+      // (neighbors not heard for longer, eg: after the node has been moved, are not candidates)
+      choose_parent(conn);
+
+      if (next_round) {
+        // Periodic refresh -> forward it after a short random delay (avoid collisions)
+        TRACE(TRACE_BEACON_FORWARD_SCHEDULED, conn->beacon_seqn);
+        ctimer_set(&conn->beacon_timer, BEACON_FORWARD_DELAY, beacon_forward_cb, conn);
+      } else {
+        // Node was out of date -> spread it quickly
+        trickle_reset(conn);
+      }
 
     } else if (beacon.seqn == conn->beacon_seqn) {
-      // Beacon is not new and is not old -> could have a better metric
-
-      if ((beacon.metric == (conn->metric - 1))  && (rssi > conn->parent_rssi)) {
-        // Beacon metric is the same has the current one but rssi is better -> update parent
-        update_node_parent(conn, beacon.metric, sender, rssi); // Update current parent
+      // Beacon is not new and is not old -> could have a better path cost
 
-      } else if (beacon.metric < conn->metric) {
-        // Beacon metric is better -> update parent
-        update_node_parent(conn, beacon.metric, sender, rssi); // Update current parent
+      if (!choose_parent(conn)) {
+        // Beacon brings no new info
+        trickle_consistent(conn);
       }
 
     } else {
-        printf("<in_> <beacon> Received an old beacon (current node seqn %u, beacon seqn: %u). Discarded.\n",
+        TRACE(TRACE_BEACON_OLD,
           conn->beacon_seqn, beacon.seqn);
+        if (!seqn_is_next_round(conn->beacon_seqn, beacon.seqn)) {
+          // Sender is out of date -> beacon soon
+          trickle_reset(conn);
+        }
     }
 
+#if MY_COLLECT_STAGGER
+    // Cycle follows the tree: children align to their parent (in turn aligned to the sink)
+    if (linkaddr_cmp(sender, &conn->parent)) {
+      stagger_sync(conn, beacon.cycle_phase);
+    }
+#endif
+#if MY_COLLECT_REPORT_CONTROL
+    // Report rate set by the sink, spread along the tree
+    if (linkaddr_cmp(sender, &conn->parent)) {
+      report_control_update(conn, beacon.report_period, beacon.report_burst);
+    }
+#endif
+
+  }
+
+}
+
+
+// Min path cost improvement (or change) that is not noise, for a current path cost of "cost"
+static uint32_t parent_switch_margin(uint16_t cost) {
+  return MY_COLLECT_PARENT_SWITCH_THRESHOLD + (uint32_t)cost * MY_COLLECT_PARENT_SWITCH_MARGIN / 100;
+}
+
+/**
+ * Select as parent the neighbor with the best path cost (with hysteresis on the current parent).
+ * Return true if parent, metric or path cost changed (ie: the node needs to beacon the update).
+ */
+static bool choose_parent(struct my_collect_conn *conn) {
+  struct neighbor *best = neighbor_table_best(&conn->neighbors, conn->beacon_seqn);
+  struct neighbor *parent = neighbor_table_get(&conn->neighbors, &conn->parent);
+
+  if (best == NULL) {
+    return false;
+  }
+
+  if (parent != NULL && parent != best && neighbor_seqn_is_recent(parent->seqn, conn->beacon_seqn) &&
+      parent->path_etx != ETX_MAX && !linkaddr_cmp(&parent->parent, &linkaddr_node_addr) &&
+      (uint32_t)neighbor_path_cost(best) + parent_switch_margin(neighbor_path_cost(parent)) >=
+        neighbor_path_cost(parent)) {
+    best = parent; // Best neighbor is not better enough -> keep the current parent
+  }
+
+  uint16_t cost = neighbor_path_cost(best);
+  uint16_t cost_change = cost > conn->path_etx ? cost - conn->path_etx : conn->path_etx - cost;
+
+  if (best != parent || best->metric + 1 != conn->metric || cost_change > parent_switch_margin(conn->path_etx)) {
+    update_node_parent(conn, best->metric, &best->addr, best->rssi);
+    return true;
   }
 
+  // Small cost fluctuation -> update it silently
+  conn->path_etx = cost;
+  conn->parent_rssi = best->rssi;
+  return false;
 }
 
 
 void update_node_parent(struct my_collect_conn *conn, uint16_t beacon_metric, const linkaddr_t *sender, int16_t parent_rssi) {
+      bool parent_changed = !linkaddr_cmp(&conn->parent, sender);
+      struct neighbor *neighbor = neighbor_table_get(&conn->neighbors, sender);
+
       // Update current metric info and update parent
       conn->metric = beacon_metric + 1;
       conn->parent_rssi = parent_rssi;
+      conn->path_etx = neighbor != NULL ? neighbor_path_cost(neighbor) : ETX_MAX;
       linkaddr_copy(&conn->parent, sender);
 
-      printf("<in_> <beacon> Node has a new parent %02x:%02x (current metric: %u, parent rssi: %d)\n",
-        sender->u8[0], sender->u8[1], conn->metric, conn->parent_rssi);
+      // Retransmit beacon to other nodes (with updated seqn/metric): this is an inconsistency for
+      // trickle, so the beacon is sent after a short random delay (avoid collisions)
+      trickle_reset(conn);
+
+      if (!parent_changed) {
+        TRACE(TRACE_PARENT_UPDATED,
+          sender->u8[0], sender->u8[1], conn->metric, conn->path_etx, conn->parent_rssi);
+        return; // Sink already knows the parent
+      }
+
+      conn->topology_epoch++;
+      conn->stats.parent_changes++;
 
-      // Retransmit beacon to other nodes (with updated metric)
-      // Wait some random time to avoid (hopefully) collisions
-      printf("<in_> <beacon> Schedule beacon forwarding in %lu seconds\n", BEACON_FORWARD_DELAY);
-      // send_beacon(conn);
-      // NB: here "&conn->beacon_timer" is used since in normal node it is unused and
-      // in sink these lines of code are never executed (sink has always metric = 0)
-      ctimer_set(&conn->beacon_timer, BEACON_FORWARD_DELAY, send_beacon_cb, conn);
+      TRACE(TRACE_PARENT_NEW,
+        sender->u8[0], sender->u8[1], conn->metric, conn->path_etx, conn->parent_rssi);
 
       // Inform the sink of the new parent using a dedicated topology report
       unsigned short topology_report_delay = BEACON_FORWARD_DELAY + ((MAX_PATH_LENGTH - conn->metric) * (random_rand() % CLOCK_SECOND));
@@ -174,24 +556,321 @@ void update_node_parent(struct my_collect_conn *conn, uint16_t beacon_metric, co
       if (topology_report_delay > BEACON_INTERVAL) {
         topology_report_delay = BEACON_INTERVAL / 2;
       }
+#if MY_COLLECT_REPORT_CONTROL
+      // Back off while the parent keeps changing (a single report for the last parent)
+      topology_report_delay = report_delay(conn, topology_report_delay);
+#endif
 
-      printf("<in_> <beacon> Schedule sending of dedicated topology report in %u seconds\n", topology_report_delay);
-      ctimer_set(&dedicated_topology_report_timer, topology_report_delay, send_topology_report_cb, conn);
+      TRACE(TRACE_TOPOLOGY_REPORT_SCHEDULED, topology_report_delay);
+      ctimer_set(&conn->topology_report_timer, topology_report_delay, send_topology_report_cb, conn);
 }
 
 
 /* Send topology reports --------------------------------------------------------------*/
 
+#if MY_COLLECT_REPORT_CONTROL
+// Delay of the report of a parent change, doubled at every change within the churn window
+static clock_time_t report_delay(struct my_collect_conn *conn, clock_time_t delay) {
+  clock_time_t now = clock_time();
+  clock_time_t since_change = now - conn->report_last_change;
+  uint32_t backoff_delay;
+
+  if (since_change < MY_COLLECT_REPORT_CHURN_WINDOW) {
+    if (conn->report_backoff < MY_COLLECT_REPORT_MAX_BACKOFF) {
+      conn->report_backoff++;
+    }
+  } else {
+    conn->report_backoff = 0;
+  }
+  conn->report_last_change = now;
+
+  backoff_delay = (uint32_t)delay << conn->report_backoff;
+  return backoff_delay < MY_COLLECT_REPORT_MAX_DELAY ? backoff_delay : MY_COLLECT_REPORT_MAX_DELAY;
+}
+
+// Add the tokens earned since the last refill (the bucket holds at most report_burst tokens)
+static void report_refill(struct my_collect_conn *conn) {
+  clock_time_t period = (clock_time_t)conn->report_period * CLOCK_SECOND;
+  clock_time_t now = clock_time();
+  clock_time_t elapsed = now - conn->report_refill_time;
+
+  while (period > 0 && conn->report_tokens < conn->report_burst && elapsed >= period) {
+    conn->report_tokens++;
+    conn->report_refill_time += period;
+    elapsed -= period;
+  }
+  if (period == 0 || conn->report_tokens >= conn->report_burst) {
+    // Full bucket: the next token is earned a period after the next report
+    conn->report_tokens = conn->report_burst;
+    conn->report_refill_time = now;
+  }
+}
+
+// An upward packet carrying the current parent of the node makes its pending report redundant
+static void report_suppress(struct my_collect_conn *conn) {
+  if (ctimer_expired(&conn->topology_report_timer) == 0) {
+    ctimer_stop(&conn->topology_report_timer);
+    conn->stats.topology_reports_suppressed++;
+    TRACE(TRACE_TOPOLOGY_REPORT_SUPPRESSED);
+  }
+}
+
+// Adopt the report rate advertised by the parent (and advertise it to the children)
+static void report_control_update(struct my_collect_conn *conn, uint8_t period, uint8_t burst) {
+  if (period == conn->report_period && burst == conn->report_burst) {
+    return;
+  }
+
+  conn->report_period = period;
+  conn->report_burst = burst;
+  report_refill(conn);
+  TRACE(TRACE_REPORT_CONTROL_UPDATED, period, burst);
+  trickle_reset(conn);
+}
+
+void my_collect_report_control_set(struct my_collect_conn *conn, uint8_t period, uint8_t burst) {
+  report_control_update(conn, period, burst);
+}
+#endif
+
 void send_topology_report_cb(void* ptr) {
   // Cast param
   struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
 
+#if MY_COLLECT_REPORT_CONTROL
+  if (conn->report_burst == 0) { // Dedicated reports disabled by the sink
+    conn->stats.topology_reports_suppressed++;
+    TRACE(TRACE_TOPOLOGY_REPORT_SUPPRESSED);
+    return;
+  }
+
+  report_refill(conn);
+  if (conn->report_tokens == 0) {
+    // Retry when the next token is earned (data packets sent meanwhile may carry the topology)
+    clock_time_t elapsed = clock_time() - conn->report_refill_time;
+    clock_time_t wait = (clock_time_t)conn->report_period * CLOCK_SECOND - elapsed;
+    TRACE(TRACE_TOPOLOGY_REPORT_DEFERRED, wait);
+    ctimer_set(&conn->topology_report_timer, wait, send_topology_report_cb, conn);
+    return;
+  }
+  conn->report_tokens--;
+#endif
+
   packetbuf_clear();
   packetbuf_set_datalen(0);
   int res = my_collect_send(conn);
-  printf("<out> <toprep> Sent dedicated topology report result: %d\n", res);
+  if (res) { // Not counted if dropped (no parent, queue full)
+    conn->stats.topology_reports_sent++;
+  }
+  TRACE(TRACE_TOPOLOGY_REPORT_SENT, res);
+}
+
+/* Statistics -------------------------------------------------------------------------*/
+
+const struct my_collect_stats* my_collect_stats_get(const struct my_collect_conn *conn) {
+  return &conn->stats;
+}
+
+uint32_t my_collect_stats_drops(const struct my_collect_conn *conn) {
+  uint32_t total = 0;
+  int i;
+
+  for (i = 0; i < MY_COLLECT_DROP_REASON_COUNT; i++) {
+    total += conn->stats.drops[i];
+  }
+  return total;
+}
+
+void my_collect_stats_reset(struct my_collect_conn *conn) {
+  memset(&conn->stats, 0, sizeof(struct my_collect_stats));
+}
+
+#if MY_COLLECT_STATS_REPORT
+/**
+ * Write a snapshot of the counters (see COLLECT_FLAG_STATS) into buffer.
+ * Return its length (at most 1 + 3 bytes per counter).
+ */
+static uint8_t stats_encode(const struct my_collect_stats *stats, uint8_t *buffer) {
+  const uint16_t *counters = (const uint16_t *)stats;
+  uint8_t length = 0;
+  int i;
+
+  buffer[length++] = MY_COLLECT_STATS_COUNTERS;
+  for (i = 0; i < MY_COLLECT_STATS_COUNTERS; i++) {
+    uint16_t value = counters[i];
+
+    // 7 bits per byte, least significant first: small counters take a single byte
+    while (value >= 0x80) {
+      buffer[length++] = (value & 0x7F) | 0x80;
+      value >>= 7;
+    }
+    buffer[length++] = value;
+  }
+
+  return length;
+}
+
+// Ask to attach a snapshot to the next upward packet, or send it now if the last one is still pending
+static void stats_timer_cb(void *ptr) {
+  struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
+
+  ctimer_reset(&conn->stats_timer);
+
+  if (conn->stats_report_pending) { // Nothing sent during a whole interval
+    packetbuf_clear();
+    packetbuf_set_datalen(0);
+    int res = my_collect_send(conn);
+    TRACE(TRACE_STATS_REPORT_SENT, res);
+  } else {
+    conn->stats_report_pending = true;
+  }
+}
+#endif
+
+/**
+ * Read a snapshot of the counters (see COLLECT_FLAG_STATS) of at most "max_length" bytes.
+ * Counters unknown to this node are skipped, counters not in the snapshot are zero.
+ * Return the snapshot length or -1 if it is malformed.
+ */
+static int stats_decode(const uint8_t *buffer, int max_length, struct my_collect_stats *stats) {
+  uint16_t *counters = (uint16_t *)stats;
+  int length = 0;
+  int count, i;
+
+  memset(stats, 0, sizeof(struct my_collect_stats));
+
+  if (max_length < 1) {
+    return -1;
+  }
+  count = buffer[length++];
+
+  for (i = 0; i < count; i++) {
+    uint16_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do {
+      if (length >= max_length || shift > 14) {
+        return -1;
+      }
+      byte = buffer[length++];
+      value |= (uint16_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+
+    if (i < MY_COLLECT_STATS_COUNTERS) {
+      counters[i] = value;
+    }
+  }
+
+  return length;
+}
+
+
+/* Latency ----------------------------------------------------------------------------*/
+
+#if MY_COLLECT_LATENCY
+const struct my_collect_latency* my_collect_latency_get(const struct my_collect_conn *conn) {
+  return &conn->latency;
+}
+
+/**
+ * Add "ticks" to the residence time of the packet (header + data) in the queue of the current node,
+ * or of every record of a batch.
+ */
+static void latency_add(uint8_t *packet, uint16_t length, uint16_t ticks) {
+  struct collect_header hdr;
+  uint16_t offset;
+
+  if (length < sizeof(struct collect_header)) {
+    return;
+  }
+  memcpy(&hdr, packet, sizeof(struct collect_header));
+
+  if (hdr.flags & COLLECT_FLAG_BATCH) {
+    for (offset = sizeof(struct collect_header); offset < length; offset += 1 + packet[offset]) {
+      if (packet[offset] < sizeof(struct collect_header) || offset + 1 + packet[offset] > length) {
+        return;
+      }
+      latency_add(packet + offset + 1, packet[offset], ticks);
+    }
+    return;
+  }
+
+  hdr.hop_delay += ticks;
+  memcpy(packet, &hdr, sizeof(struct collect_header));
+}
+
+/**
+ * End of the residence time in the queue of the last node crossed (the packet has been received):
+ * add it to the delay of the packet and to the per-node extremes. "nodes" is the number of nodes
+ * that have queued the packet (last one included).
+ */
+static void latency_hop(struct collect_header *hdr, uint8_t nodes) {
+  uint8_t ticks = hdr->hop_delay > 0xFF ? 0xFF : hdr->hop_delay;
+
+  hdr->delay += hdr->hop_delay;
+  hdr->hop_delay = 0;
+  if (nodes == 1 || ticks < hdr->hop_delay_min) {
+    hdr->hop_delay_min = ticks;
+  }
+  if (nodes == 1 || ticks > hdr->hop_delay_max) {
+    hdr->hop_delay_max = ticks;
+  }
+}
+
+/**
+ * Start of the residence time of the packet (header + data, not a batch) in the queue of the current
+ * node. Forwarded packets (hops already incremented) close the residence time of the previous node.
+ */
+static void latency_arrival(uint8_t *packet, uint16_t length) {
+  struct collect_header hdr;
+
+  if (length < sizeof(struct collect_header)) {
+    return;
+  }
+  memcpy(&hdr, packet, sizeof(struct collect_header));
+
+  if (hdr.hops > 0) {
+    latency_hop(&hdr, hdr.hops);
+  }
+  hdr.hop_delay = -clock_time();
+  memcpy(packet, &hdr, sizeof(struct collect_header));
 }
 
+// Convert a delay in clock ticks to ms (saturated at 0xFFFF)
+static uint16_t latency_ms(uint32_t ticks) {
+  uint32_t ms = ticks * 1000 / CLOCK_SECOND;
+
+  return ms > 0xFFFF ? 0xFFFF : ms;
+}
+
+// Save the delays of a packet delivered to the app (the "hops + 1" nodes of its path queued it)
+static void latency_record(struct my_collect_conn *conn, const struct collect_header *hdr) {
+  struct collect_header completed = *hdr;
+  uint32_t delay;
+  uint8_t bucket = 0;
+
+  latency_hop(&completed, hdr->hops + 1);
+
+  conn->latency.delay = latency_ms(completed.delay);
+  conn->latency.hop_delay = conn->latency.delay / (hdr->hops + 1);
+  conn->latency.hop_delay_min = latency_ms(completed.hop_delay_min);
+  conn->latency.hop_delay_max = latency_ms(completed.hop_delay_max);
+
+  delay = conn->latency.delay;
+  while (delay > 0 && bucket < MY_COLLECT_LATENCY_BUCKETS - 1) {
+    delay >>= 1;
+    bucket++;
+  }
+  conn->latency.histogram[bucket]++;
+
+  TRACE(TRACE_LATENCY_MEASURED, hdr->source.u8[0], hdr->source.u8[1], conn->latency.delay, hdr->hops + 1,
+    conn->latency.hop_delay_min, conn->latency.hop_delay_max);
+}
+#endif
+
+
 /* Handling data packets --------------------------------------------------------------*/
 
 // Our send function
@@ -199,10 +878,38 @@ int my_collect_send(struct my_collect_conn *conn) {
 
   // is_command=false -> this is NOT a packet routed from sink (it is a data collection packet)
   // path_length=1 -> add current node to the path array
-  struct collect_header hdr = {.source=linkaddr_node_addr, .hops=0, .is_command=false, .path_length=1};
+  struct collect_header hdr = {.source=linkaddr_node_addr, .hops=0, .seqn=conn->packet_seqn++, .is_command=false,
+    .path_length=1, .flags=0};
+
+  if (MY_COLLECT_COMPACT_PATH && PATH_ENTRY_IS_COMPACT(&linkaddr_node_addr)) {
+    hdr.flags |= COLLECT_FLAG_COMPACT_PATH;
+  }
+  uint8_t entry_size = header_entry_size(&hdr);
+  uint8_t stats_length = 0;
+
+  if (packetbuf_datalen() > 0) { // Not a dedicated report
+    conn->stats.data_originated++;
+  }
+
+#if MY_COLLECT_TOPOLOGY_MODE == MY_COLLECT_TOPOLOGY_PARENT_REPORT
+  // Constant size topology info: <parent, current node> pair instead of the path array
+  hdr.path_length = 0;
+  hdr.flags = COLLECT_FLAG_PARENT_REPORT;
+  entry_size = sizeof(struct parent_report);
+#endif
+
+#if MY_COLLECT_STATS_REPORT
+  // Snapshot of the counters to attach after the topology info
+  uint8_t stats_snapshot[1 + MY_COLLECT_STATS_COUNTERS * 3];
+  if (conn->stats_report_pending) {
+    stats_length = stats_encode(&conn->stats, stats_snapshot);
+    hdr.flags |= COLLECT_FLAG_STATS;
+  }
+#endif
 
   if (linkaddr_cmp(&conn->parent, &linkaddr_null)) {
-    printf("<out> <packet> <ERROR> Trying to send a data collection packet but node's parent is missing!\n");
+    conn->stats.drops[MY_COLLECT_DROP_NO_PARENT]++;
+    TRACE(TRACE_SEND_NO_PARENT);
     return 0; // no parent
   }
 
@@ -212,21 +919,79 @@ int my_collect_send(struct my_collect_conn *conn) {
   //  - send the packet to the parent using unicast
 
   // Try to allocate space
-  int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + sizeof(linkaddr_t)); // header + path array
+  int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + entry_size + stats_length); // header + path array + stats
 
   if (alloc_res == 0) { // Allocation failed -> report error
-    printf("<out> <packet> <ERROR> Trying to send a data collection packet but node fails allocating header buffer!\n");
+    conn->stats.drops[MY_COLLECT_DROP_HDRALLOC]++;
+    TRACE(TRACE_SEND_HDRALLOC_FAILED);
     return 0;
   }
 
   // Add header to packet
   memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct collect_header));
+#if MY_COLLECT_TOPOLOGY_MODE == MY_COLLECT_TOPOLOGY_PARENT_REPORT
+  // Add current parent and topology epoch after the header
+  struct parent_report report = {.parent = conn->parent, .epoch = conn->topology_epoch};
+  memcpy(packetbuf_hdrptr() + sizeof(struct collect_header), &report, sizeof(struct parent_report));
+#else
   // Add current node to path array after the header
-  memcpy(packetbuf_hdrptr() + sizeof(struct collect_header), &linkaddr_node_addr, sizeof(linkaddr_t));
+  path_entry_write(packetbuf_hdrptr() + sizeof(struct collect_header), 0, entry_size, &linkaddr_node_addr);
+#endif
+#if MY_COLLECT_STATS_REPORT
+  if (stats_length > 0) {
+    memcpy(packetbuf_hdrptr() + sizeof(struct collect_header) + entry_size, stats_snapshot, stats_length);
+    conn->stats_report_pending = false;
+    TRACE(TRACE_STATS_ATTACHED, stats_length);
+  }
+#endif
   // Send packet to parent
-  printf("<out> <packet> Sending data collection packet to %02x:%02x\n", conn->parent.u8[0], conn->parent.u8[1]);
+  TRACE(TRACE_PACKET_SENT, conn->parent.u8[0], conn->parent.u8[1]);
+
+  int res = queue_send(conn, &linkaddr_null);
+#if MY_COLLECT_REPORT_CONTROL
+  if (res) {
+    // The packet queued carries the current parent
+    report_suppress(conn);
+  }
+#endif
+  return res;
+}
+
+/**
+ * Return true if the packet (source, seqn) has been received recently,
+ * otherwise remember it (replacing the oldest entry) and return false.
+ */
+static bool is_duplicate(struct my_collect_conn *conn, const struct collect_header *hdr) {
+  linkaddr_t source = hdr->source;
+  int i = 0;
+
+  for (i = 0; i < MY_COLLECT_DUPLICATE_CACHE_SIZE; i++) {
+    struct recent_packet *entry = &conn->recent_packets[i];
+    if (entry->seqn == hdr->seqn && linkaddr_cmp(&entry->source, &source)) {
+      return true;
+    }
+  }
+
+  linkaddr_copy(&conn->recent_packets[conn->recent_packets_next].source, &source);
+  conn->recent_packets[conn->recent_packets_next].seqn = hdr->seqn;
+  conn->recent_packets_next = (conn->recent_packets_next + 1) % MY_COLLECT_DUPLICATE_CACHE_SIZE;
+  return false;
+}
+
+/**
+ * Return true if the path of an upward packet already contains the node (routing loop): a looped
+ * packet is not a duplicate, it is dropped (and counted) by the loop detection of the forwarding.
+ */
+static bool is_looped(struct my_collect_conn *conn, const struct collect_header *hdr) {
+  uint8_t entry_size = header_entry_size(hdr);
+
+  if (conn->is_sink || hdr->is_command || (hdr->flags & COLLECT_FLAG_PARENT_REPORT) ||
+      packetbuf_datalen() < sizeof(struct collect_header) + (entry_size * hdr->path_length)) {
+    return false;
+  }
 
-  return unicast_send(&conn->uc, &conn->parent);
+  return check_loop_presence((uint8_t *)packetbuf_dataptr() + sizeof(struct collect_header), hdr->path_length,
+    entry_size, linkaddr_node_addr) > 0;
 }
 
 // Data receive callback
@@ -238,7 +1003,8 @@ void uc_recv(struct unicast_conn *uc_conn, const linkaddr_t *from) {
   struct collect_header hdr;
 
   if (packetbuf_datalen() < sizeof(struct collect_header)) {
-    printf("<in_> <packet> <ERROR> Received a too short unicast packet! (length: %d)\n", packetbuf_datalen());
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_RECV_TOO_SHORT, packetbuf_datalen());
     return;
   }
 
@@ -251,11 +1017,27 @@ void uc_recv(struct unicast_conn *uc_conn, const linkaddr_t *from) {
   memcpy(&hdr, packetbuf_dataptr(), sizeof(struct collect_header));
 
 
-  if (hdr.is_command) { // Packet is of type "command" (sent from sink)
+#if MY_COLLECT_STAGGER
+  if (!hdr.is_command) { // Upward packet of a child -> keep listening in the slot of the children
+    conn->stagger_idle_cycles = 0;
+  }
+#endif
+
+  if (!(hdr.flags & COLLECT_FLAG_BATCH) && !is_looped(conn, &hdr) && is_duplicate(conn, &hdr)) {
+    // Retransmission of a packet already received (its ACK was lost) -> drop it
+    conn->stats.drops[MY_COLLECT_DROP_DUPLICATE]++;
+    TRACE(TRACE_RECV_DUPLICATE,
+      from->u8[0], from->u8[1], hdr.source.u8[0], hdr.source.u8[1], hdr.seqn);
+    return;
+  }
+
+  if (hdr.flags & COLLECT_FLAG_BATCH) { // Packet contains other packets
+    handle_recv_batch_packet(conn, &hdr, from);
+  } else if (hdr.is_command) { // Packet is of type "command" (sent from sink)
     handle_recv_command_packet(conn, &hdr, from);
   } else { // Packet is of type "data collection"
 
-    if (is_the_sink) {
+    if (conn->is_sink) {
       // Sink ///////////////////////////////////////
       handle_recv_data_collection_packet_sink(conn, &hdr, from);
     } else {
@@ -267,63 +1049,553 @@ void uc_recv(struct unicast_conn *uc_conn, const linkaddr_t *from) {
 }
 
 
-/**
- * Handle the reception of a data collection packet.
- * If node is sink -> deliver packet to app
- * If node is a common node -> forward packet to parent
- *
- */
-void handle_recv_data_collection_packet_sink(struct my_collect_conn *conn, struct collect_header *hdr, const linkaddr_t *from) {
+// Unicast sent callback: update the estimation of the link used
+void uc_sent(struct unicast_conn *uc_conn, int status, int num_tx) {
+  struct my_collect_conn* conn = (struct my_collect_conn*)(((uint8_t*)uc_conn) -
+    offsetof(struct my_collect_conn, uc));
+  linkaddr_t receiver;
+
+  linkaddr_copy(&receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  neighbor_table_update_tx(&conn->neighbors, &receiver, status == MAC_TX_OK, num_tx);
+
+  // NB: the parent is evaluated again at the next beacon (not at every packet: link ETX noise)
+
+  if (status != MAC_TX_DEFERRED) {
+    queue_sent(conn, status);
+  }
+}
+
+
+/* Queue ------------------------------------------------------------------------------*/
+
+#if MY_COLLECT_STAGGER
+/**
+ * Move the first command of the queue (if any) to the head, before the upward packets waiting for
+ * the slot of the node. Return false if there are only upward packets.
+ */
+static bool queue_promote_command(struct my_collect_conn *conn) {
+  uint8_t i, j;
+
+  for (i = 1; i < conn->queue_length; i++) {
+    uint8_t index = (conn->queue_head + i) % MY_COLLECT_QUEUE_SIZE;
+
+    if (!linkaddr_cmp(&conn->queue[index].next_hop, &linkaddr_null)) {
+      // Rotate [head, index] by one (upward packets keep their order)
+      struct queued_packet command = conn->queue[index];
+      for (j = i; j > 0; j--) {
+        conn->queue[(conn->queue_head + j) % MY_COLLECT_QUEUE_SIZE] =
+          conn->queue[(conn->queue_head + j - 1) % MY_COLLECT_QUEUE_SIZE];
+      }
+      conn->queue[conn->queue_head] = command;
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+static void queue_retry_cb(void *ptr) {
+  queue_transmit_head((struct my_collect_conn *)ptr);
+}
+
+/**
+ * Count a retry of the packet at the head of the queue and send it again out of the sent callback:
+ * after a random backoff (doubled at every retry) to the same next hop, right away after a failover
+ * to a backup parent. Return false if it has no retries left.
+ */
+static bool queue_retry(struct my_collect_conn *conn, struct queued_packet *packet, bool failover) {
+  clock_time_t delay = 0;
+
+  if (!failover && packet->retries >= MY_COLLECT_MAX_RETRIES) {
+    return false;
+  }
+  packet->retries++;
+
+  if (!failover) {
+    uint8_t shift = packet->retries > 4 ? 4 : packet->retries - 1;
+    clock_time_t backoff = (clock_time_t)MY_COLLECT_RETRY_BACKOFF << shift;
+    delay = backoff + (backoff > 0 ? random_rand() % backoff : 0);
+  }
+
+  TRACE(TRACE_QUEUE_RETRY_SCHEDULED, packet->retries, delay);
+  ctimer_set(&conn->queue_retry_timer, delay, queue_retry_cb, conn);
+  return true;
+}
+
+// Remove the packet at the head of the queue
+static void queue_pop(struct my_collect_conn *conn) {
+  conn->queue_head = (conn->queue_head + 1) % MY_COLLECT_QUEUE_SIZE;
+  conn->queue_length--;
+}
+
+// Send the packet at the head of the queue (if any)
+static void queue_transmit_head(struct my_collect_conn *conn) {
+  while (conn->queue_length > 0) {
+    struct queued_packet *packet = &conn->queue[conn->queue_head];
+    bool upward = linkaddr_cmp(&packet->next_hop, &linkaddr_null);
+    const linkaddr_t *next_hop = upward ? &conn->parent : &packet->next_hop;
+
+    if (upward && linkaddr_cmp(&conn->parent, &linkaddr_null)) {
+      conn->stats.drops[MY_COLLECT_DROP_NO_PARENT]++;
+      TRACE(TRACE_QUEUE_NO_PARENT);
+      queue_pop(conn);
+      continue;
+    }
+
+#if MY_COLLECT_STAGGER
+    if (upward && !stagger_may_send(conn)) {
+      // Wait for the slot of the node (see stagger_schedule), commands queued behind go first
+      if (!queue_promote_command(conn)) {
+        conn->stagger_held = true;
+        return;
+      }
+      continue;
+    }
+#endif
+
+    packetbuf_clear();
+    packetbuf_copyfrom(packet->data, packet->length);
+#if MY_COLLECT_LATENCY
+    // End of the residence time (in packetbuf only: retransmissions count it again)
+    latency_add(packetbuf_dataptr(), packetbuf_datalen(), clock_time());
+#endif
+    // NB: with some MAC layers the sent callback is called before unicast_send returns
+    if (unicast_send(&conn->uc, next_hop)) {
+      return;
+    }
+
+    // Not sent and no sent callback will come (the link is not to blame: no failover)
+    TRACE(TRACE_QUEUE_SEND_FAILED, packet->retries);
+    if (queue_retry(conn, packet, false)) {
+      return;
+    }
+    conn->stats.drops[MY_COLLECT_DROP_NOACK]++;
+    TRACE(TRACE_QUEUE_RETRIES_EXCEEDED, packet->retries);
+    queue_pop(conn);
+  }
+}
+
+/**
+ * Add the packet in packetbuf (header + data) to the queue.
+ * Return 0 if the queue is full or the packet is empty or too long (packet dropped).
+ */
+static int queue_send(struct my_collect_conn *conn, const linkaddr_t *next_hop) {
+  if (conn->queue_length == MY_COLLECT_QUEUE_SIZE) {
+    conn->stats.drops[MY_COLLECT_DROP_QUEUE_FULL]++;
+    TRACE(TRACE_QUEUE_FULL, conn->queue_length);
+    return 0;
+  }
+
+  struct queued_packet *packet = &conn->queue[(conn->queue_head + conn->queue_length) % MY_COLLECT_QUEUE_SIZE];
+  // packetbuf_copyto returns 0 if header + data do not fit in PACKETBUF_SIZE: the slot is not taken
+  int length = packetbuf_copyto(packet->data);
+  if (length <= 0 || length > PACKETBUF_SIZE) {
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_QUEUE_BAD_LENGTH, packetbuf_totlen());
+    return 0;
+  }
+  linkaddr_copy(&packet->next_hop, next_hop);
+  packet->length = length;
+#if MY_COLLECT_LATENCY
+  // Start of the residence time (records of a batch start from their arrival in the batch)
+  if (!(((struct collect_header *)packet->data)->flags & COLLECT_FLAG_BATCH)) {
+    latency_arrival(packet->data, packet->length);
+  }
+#endif
+  packet->retries = 0;
+  packet->failovers = 0;
+  conn->queue_length++;
+
+  if (conn->queue_length == 1) { // Nothing in flight -> send now
+    queue_transmit_head(conn);
+  }
+  return 1;
+}
+
+// Switch to the best backup parent for the upward packet at the head of the queue
+static bool queue_failover(struct my_collect_conn *conn, struct queued_packet *packet) {
+  struct collect_header hdr;
+
+  if (packet->failovers >= MY_COLLECT_MAX_FAILOVERS) {
+    return false;
+  }
+
+  // Backup parents are neighbors strictly closer than the node to the sink (children are excluded)
+  struct neighbor *backup = neighbor_table_best_candidate(&conn->neighbors, conn->beacon_seqn,
+    conn->metric, conn->path_etx, &conn->parent);
+
+  if (backup == NULL) {
+    return false;
+  }
+
+  TRACE(TRACE_PARENT_FAILOVER,
+    conn->parent.u8[0], conn->parent.u8[1], backup->addr.u8[0], backup->addr.u8[1]);
+
+  // New parent (also beaconed and reported to sink)
+  update_node_parent(conn, backup->metric, &backup->addr, backup->rssi);
+  packet->failovers++;
+
+  // Own packet with a parent report -> report the new parent
+  memcpy(&hdr, packet->data, sizeof(struct collect_header));
+  if ((hdr.flags & COLLECT_FLAG_PARENT_REPORT) && hdr.hops == 0 && !hdr.is_command &&
+      packet->length >= sizeof(struct collect_header) + sizeof(struct parent_report)) {
+    struct parent_report report = {.parent = conn->parent, .epoch = conn->topology_epoch};
+    memcpy(packet->data + sizeof(struct collect_header), &report, sizeof(struct parent_report));
+  }
+  return true;
+}
+
+// MAC outcome of the packet at the head of the queue
+static void queue_sent(struct my_collect_conn *conn, int status) {
+  if (conn->queue_length == 0) {
+    return;
+  }
+
+  struct queued_packet *packet = &conn->queue[conn->queue_head];
+
+  if (status != MAC_TX_OK) {
+    // Upward packet -> retry through a backup parent, otherwise retry the same next hop
+    bool upward = linkaddr_cmp(&packet->next_hop, &linkaddr_null);
+    bool failover = upward && !conn->is_sink && queue_failover(conn, packet);
+
+    if (queue_retry(conn, packet, failover)) {
+      return;
+    }
+
+    conn->stats.drops[MY_COLLECT_DROP_NOACK]++;
+    TRACE(TRACE_QUEUE_RETRIES_EXCEEDED, packet->retries);
+  }
+
+  // Packet done -> send the next one in order
+  queue_pop(conn);
+  queue_transmit_head(conn);
+}
+
+
+/**
+ * Save into the routing table the topology info attached to the header of the packet in packetbuf
+ * (path array or parent report).
+ * Return the size in bytes of the topology info or -1 if the packet is malformed.
+ */
+static int sink_update_routing_table(struct my_collect_conn *conn, const struct collect_header *hdr) {
+  const uint8_t *topology = packetbuf_dataptr() + sizeof(struct collect_header);
+
+  if (hdr->flags & COLLECT_FLAG_PARENT_REPORT) {
+    // Parent report -> a single <parent, source> relationship
+    struct parent_report report;
+
+    if (packetbuf_datalen() < sizeof(struct collect_header) + sizeof(struct parent_report)) {
+      TRACE(TRACE_SINK_REPORT_TOO_SHORT);
+      return -1;
+    }
+
+    memcpy(&report, topology, sizeof(struct parent_report));
+    // Copy addresses out of the packed structs
+    linkaddr_t parent = report.parent;
+    linkaddr_t source = hdr->source;
+    routing_table_update_report(conn->routing_table, &parent, &source, report.epoch);
+    return sizeof(struct parent_report);
+  }
 
   // Collect all <parent, child> relationships contained into the path
   uint8_t path_length = hdr->path_length;
-  linkaddr_t path[path_length];
-
-  // Get route path from packet
-  memcpy(&path, packetbuf_dataptr() + sizeof(struct collect_header), sizeof(linkaddr_t) * path_length);
+  uint8_t entry_size = header_entry_size(hdr);
 
   if (path_length == 0) { // Error -> "no one send me the packet" -> some node does not respect model
-    printf("<in_> <packet> <ERROR> path_length value in header is wrong -> path_length is 0\n");
-    return;
+    TRACE(TRACE_SINK_PATH_EMPTY);
+    return -1;
+  }
+
+  if (packetbuf_datalen() < sizeof(struct collect_header) + (entry_size * path_length)) {
+    TRACE(TRACE_SINK_PATH_TOO_SHORT, path_length);
+    return -1;
   }
 
   // Save <parent, child> relationship into routing table
   // Iterate over "path" array and consider i-element as parent and (i+1)-element as child
   int i;
+  linkaddr_t parent, child;
   for (i = 0; i < (path_length - 1); i++) { // -1 last element has no child
-    linkaddr_t parent = path[i];
-    linkaddr_t child = path[i + 1];
+    path_entry_read(topology, i, entry_size, &parent);
+    path_entry_read(topology, i + 1, entry_size, &child);
     // Update routing table
-    routing_table_update_entry(&parent, &child);
+    routing_table_update_entry(conn->routing_table, &parent, &child);
   }
   // Add special pair <sink, last_path_elem>
-  routing_table_update_entry(&linkaddr_node_addr, &path[0]);
+  path_entry_read(topology, 0, entry_size, &child);
+  routing_table_update_entry(conn->routing_table, &linkaddr_node_addr, &child);
+
+  return entry_size * path_length;
+}
+
+/**
+ * Handle the reception of a data collection packet.
+ * If node is sink -> deliver packet to app
+ * If node is a common node -> forward packet to parent
+ *
+ */
+void handle_recv_data_collection_packet_sink(struct my_collect_conn *conn, struct collect_header *hdr, const linkaddr_t *from) {
+  // Aligned copy of the source (hdr is packed)
+  linkaddr_t source = hdr->source;
+
+  // Learn topology from packet and get the size of the topology info attached to the header
+  int topology_size = sink_update_routing_table(conn, hdr);
+
+  if (topology_size < 0) {
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    return;
+  }
+#if MY_COLLECT_ROUTE_DISCOVERY
+  rreq_heard(conn, &source);
+#endif
+
+  int stats_size = 0;
+  if (hdr->flags & COLLECT_FLAG_STATS) {
+    // Snapshot of the counters of the source
+    struct my_collect_stats stats;
+    int offset = sizeof(struct collect_header) + topology_size;
+    linkaddr_t source = hdr->source;
+
+    stats_size = stats_decode(packetbuf_dataptr() + offset, packetbuf_datalen() - offset, &stats);
+    if (stats_size < 0) {
+      conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+      TRACE(TRACE_SINK_STATS_MALFORMED);
+      return;
+    }
+
+    TRACE(TRACE_SINK_STATS_RECEIVED, source.u8[0], source.u8[1],
+      stats.data_originated, stats.data_forwarded, stats.parent_changes, stats.drops[MY_COLLECT_DROP_NOACK]);
+    if (conn->callbacks->stats_recv != NULL) {
+      conn->callbacks->stats_recv(&source, &stats);
+    }
+  }
 
   // Remove header
-  int hdr_reduce_res = packetbuf_hdrreduce(sizeof(struct collect_header) + (sizeof(linkaddr_t) * path_length));
+  int hdr_reduce_res = packetbuf_hdrreduce(sizeof(struct collect_header) + topology_size + stats_size);
 
   if (hdr_reduce_res == 0) {
-    printf("<in_> <packet> <ERROR> Fail to reduce header. Packet will not be delivered to app!\n");
+    conn->stats.drops[MY_COLLECT_DROP_HDRREDUCE]++;
+    TRACE(TRACE_SINK_HDRREDUCE_FAILED);
     return;
   }
 
   // Check if packet is of type "data collection" or "dedicated topology report" (ie: it has no data part)
   if (packetbuf_datalen() == 0) {
     // Dedicated topology packet should not be delivered to app
-    printf("<in_> <packet> <SUCCESS> Dedicated topology packet arrived to the sink (source: %02x:%02x, hops: %u)\n",
+    TRACE(TRACE_SINK_TOPOLOGY_REPORT_RECEIVED,
       hdr->source.u8[0], hdr->source.u8[1], hdr->hops);
 
   } else {
+#if MY_COLLECT_LATENCY
+    latency_record(conn, hdr);
+#endif
     // Deliver packet to application
-    conn->callbacks->recv(&(hdr->source), hdr->hops);
+    conn->callbacks->recv(&source, hdr->hops);
+    conn->stats.data_delivered++;
 
-    printf("<in_> <packet> <SUCCESS> Packet arrived to the sink and delivered! (source: %02x:%02x, hops: %u)\n",
+    TRACE(TRACE_SINK_PACKET_DELIVERED,
       hdr->source.u8[0], hdr->source.u8[1], hdr->hops);
   }
 
 }
 
 
+/* Batching ---------------------------------------------------------------------------*/
+
+#if MY_COLLECT_BATCHING
+// Send the batched packets to the parent in a single frame
+static void batch_flush_cb(void *ptr) {
+  struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
+  // seqn is not used: every record has its own
+  struct collect_header hdr = {.source=linkaddr_node_addr, .hops=0, .seqn=0, .is_command=false, .path_length=0,
+    .flags=COLLECT_FLAG_BATCH};
+
+  ctimer_stop(&conn->batch_timer);
+
+  if (conn->batch_length == 0) {
+    return;
+  }
+
+  packetbuf_clear();
+  packetbuf_copyfrom(conn->batch, conn->batch_length);
+  conn->batch_length = 0;
+
+  if (linkaddr_cmp(&conn->parent, &linkaddr_null)) {
+    conn->stats.drops[MY_COLLECT_DROP_NO_PARENT]++;
+    TRACE(TRACE_BATCH_NO_PARENT);
+    return;
+  }
+
+  if (packetbuf_hdralloc(sizeof(struct collect_header)) == 0) {
+    conn->stats.drops[MY_COLLECT_DROP_HDRALLOC]++;
+    TRACE(TRACE_BATCH_HDRALLOC_FAILED);
+    return;
+  }
+  memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct collect_header));
+
+  TRACE(TRACE_BATCH_SENT, packetbuf_datalen(), conn->parent.u8[0], conn->parent.u8[1]);
+  queue_send(conn, &linkaddr_null);
+}
+
+/**
+ * Append the packet in packetbuf (header + data) to the batch of the connection.
+ * Return 0 if the packet is too big to be batched.
+ */
+static int batch_add(struct my_collect_conn *conn) {
+  uint16_t length = packetbuf_totlen();
+  uint8_t *record;
+
+  if (length + 1 > MY_COLLECT_BATCH_SIZE) {
+    return 0;
+  }
+
+  if (conn->batch_length + length + 1 > MY_COLLECT_BATCH_SIZE) {
+    // No room left -> send what is already batched and start a new batch
+    // (flushing uses packetbuf -> save the current packet in the batch buffer first)
+    uint8_t packet[length];
+    packetbuf_copyto(packet);
+    batch_flush_cb(conn);
+    record = conn->batch + 1;
+    memcpy(record, packet, length);
+  } else {
+    record = conn->batch + conn->batch_length + 1;
+    packetbuf_copyto(record);
+  }
+#if MY_COLLECT_LATENCY
+  // Start of the residence time of the record
+  latency_arrival(record, length);
+#endif
+
+  conn->batch[conn->batch_length] = length;
+  conn->batch_length += length + 1;
+
+  if (ctimer_expired(&conn->batch_timer)) { // First packet of the batch -> start the window
+    ctimer_set(&conn->batch_timer, MY_COLLECT_BATCH_WINDOW, batch_flush_cb, conn);
+  }
+  return 1;
+}
+#endif
+
+/**
+ * Handle the reception of a batch: every record is handled as a packet received from the batch sender.
+ */
+static void handle_recv_batch_packet(struct my_collect_conn *conn, struct collect_header *hdr, const linkaddr_t *from) {
+  // Records are copied out of packetbuf since packetbuf is used to handle each record
+  // (on the stack: connections do not share buffers)
+  uint8_t records[PACKETBUF_SIZE];
+  uint16_t length = packetbuf_datalen() - sizeof(struct collect_header);
+  uint16_t offset = 0;
+  struct collect_header record_hdr;
+
+  TRACE(TRACE_BATCH_RECEIVED, from->u8[0], from->u8[1], length);
+  memcpy(records, packetbuf_dataptr() + sizeof(struct collect_header), length);
+
+  while (offset < length) {
+    uint8_t record_length = records[offset];
+
+    if (record_length < sizeof(struct collect_header) || offset + 1 + record_length > length) {
+      conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+      TRACE(TRACE_BATCH_MALFORMED, offset);
+      return;
+    }
+
+    memcpy(&record_hdr, records + offset + 1, sizeof(struct collect_header));
+    if (record_hdr.flags & COLLECT_FLAG_BATCH) { // Batches are never nested
+      conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+      TRACE(TRACE_BATCH_NESTED);
+    } else {
+      packetbuf_clear();
+      packetbuf_copyfrom(records + offset + 1, record_length);
+      uc_recv(&conn->uc, from);
+    }
+
+    offset += 1 + record_length;
+  }
+}
+
+/**
+ * Send the packet in packetbuf to the parent (or add it to the batch of the connection).
+ * Return 0 if the packet could not be queued.
+ */
+static int forward_to_parent(struct my_collect_conn *conn, const struct collect_header *hdr) {
+#if MY_COLLECT_BATCHING
+  if (batch_add(conn)) {
+    conn->stats.data_forwarded++;
+    TRACE(TRACE_FORWARD_BATCHED, conn->parent.u8[0], conn->parent.u8[1], hdr->hops);
+    return 1;
+  }
+#endif
+
+  // Forward the packet to parent
+  int res = queue_send(conn, &linkaddr_null);
+  conn->stats.data_forwarded++;
+  TRACE(TRACE_FORWARD_SENT, conn->parent.u8[0], conn->parent.u8[1], hdr->hops);
+  return res;
+}
+
+/**
+ * Forward a packet carrying a parent report: the header is patched in place (hops only).
+ * Without a path loops cannot be detected -> packets are dropped after MY_COLLECT_MAX_HOPS hops.
+ */
+static void forward_parent_report_packet(struct my_collect_conn *conn, struct collect_header *hdr) {
+
+  if (hdr->hops >= MY_COLLECT_MAX_HOPS) {
+    conn->stats.drops[MY_COLLECT_DROP_MAX_HOPS]++;
+    TRACE(TRACE_FORWARD_MAX_HOPS, hdr->hops);
+    return;
+  }
+
+  hdr->hops += 1;
+  memcpy(packetbuf_dataptr(), hdr, sizeof(struct collect_header));
+
+  forward_to_parent(conn, hdr);
+}
+
+/**
+ * Rewrite header and path of the packet in packetbuf re-encoding a compact path with full entries
+ * and adding the current node address in front of it.
+ * "hdr" is the already updated header, "path_length" is the length of the path in packetbuf.
+ * Return 0 on failure.
+ */
+static int forward_expand_path(struct my_collect_conn *conn, const struct collect_header *hdr, uint8_t path_length) {
+  uint8_t path[PATH_ENTRY_SIZE_COMPACT * path_length];
+  int i;
+  linkaddr_t node;
+
+  memcpy(path, packetbuf_dataptr() + sizeof(struct collect_header), sizeof(path));
+
+  // Remove header and old path
+  int hdr_reduce_res = packetbuf_hdrreduce(sizeof(struct collect_header) + sizeof(path));
+
+  if (hdr_reduce_res == 0) {
+    conn->stats.drops[MY_COLLECT_DROP_HDRREDUCE]++;
+    TRACE(TRACE_FORWARD_HDRREDUCE_FAILED);
+    return 0;
+  }
+
+  // header = header + current node addr + old path array
+  int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + (PATH_ENTRY_SIZE_FULL * hdr->path_length));
+
+  if (alloc_res == 0) { // Allocation failed -> report error
+    conn->stats.drops[MY_COLLECT_DROP_HDRALLOC]++;
+    TRACE(TRACE_FORWARD_HDRALLOC_FAILED);
+    return 0;
+  }
+
+  struct collect_header new_hdr = *hdr;
+  new_hdr.flags &= ~COLLECT_FLAG_COMPACT_PATH;
+  memcpy(packetbuf_hdrptr(), &new_hdr, sizeof(struct collect_header));
+
+  uint8_t *new_path = packetbuf_hdrptr() + sizeof(struct collect_header);
+  path_entry_write(new_path, 0, PATH_ENTRY_SIZE_FULL, &linkaddr_node_addr);
+  for (i = 0; i < path_length; i++) {
+    path_entry_read(path, i, PATH_ENTRY_SIZE_COMPACT, &node);
+    path_entry_write(new_path, i + 1, PATH_ENTRY_SIZE_FULL, &node);
+  }
+
+  return 1;
+}
+
 /**
  * Handle the reception of a data collection packet.
  * If node is sink -> deliver packet to app
@@ -335,70 +1607,215 @@ void handle_recv_data_collection_packet_node(struct my_collect_conn *conn, struc
 
   // Check for parent existence
   if (linkaddr_cmp(&conn->parent, &linkaddr_null)) {
-    printf("<in_> <packet> <ERROR> Trying to forward a packet but node's parent is missing!\n");
+    conn->stats.drops[MY_COLLECT_DROP_NO_PARENT]++;
+    TRACE(TRACE_FORWARD_NO_PARENT);
     return; // no parent
   }
 
-  // Extract routing path from packet
+  if (hdr->flags & COLLECT_FLAG_PARENT_REPORT) {
+    // Parent report is about the source only -> just update hops and forward
+    forward_parent_report_packet(conn, hdr);
+    return;
+  }
+
+  // Routing path is read directly from packet (never copied)
   uint8_t path_length = hdr->path_length;
-  linkaddr_t path[path_length];
-  memcpy(&path, packetbuf_dataptr() + sizeof(struct collect_header), sizeof(linkaddr_t) * path_length);
+  uint8_t entry_size = header_entry_size(hdr);
+  const uint8_t *path = packetbuf_dataptr() + sizeof(struct collect_header);
 
-  printf("<in_> <packet> New collection packet to forward: (from: %02x:%02x, source: %02x:%02x, hops: %u, length: %u)\n",
+  TRACE(TRACE_FORWARD_RECEIVED,
     from->u8[0], from->u8[1], hdr->source.u8[0], hdr->source.u8[1], hdr->hops, hdr->path_length);
 
+  if (packetbuf_datalen() < sizeof(struct collect_header) + (entry_size * path_length)) {
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_FORWARD_PATH_TOO_SHORT, path_length);
+    return;
+  }
+
   // Check for loops -> if this node is present in path contained in packet, packet is
   // already been forwarded by this node -> drop
-  int node_count = check_loop_presence(path, path_length, linkaddr_node_addr);
+  int node_count = check_loop_presence(path, path_length, entry_size, linkaddr_node_addr);
 
   if (node_count > 0) { // Loop -> stop forwarding
-    printf("<in_> <packet> <ERROR> Packet cannot be forwarded beacuse a loop has been detected analyzing path\n");
+    conn->stats.drops[MY_COLLECT_DROP_LOOP]++;
+    TRACE(TRACE_FORWARD_LOOP);
     return;
   }
 
-  // Remove header
-  int hdr_reduce_res = packetbuf_hdrreduce(sizeof(struct collect_header) + (sizeof(linkaddr_t) * path_length));
+#if !MY_COLLECT_REPORT_CONTROL
+  // A "dedicated topology report" has no data
+  bool topology_report = packetbuf_datalen() == sizeof(struct collect_header) + (entry_size * path_length);
+#endif
 
-  if (hdr_reduce_res == 0) {
-    printf("<in_> <packet> <ERROR> Fail to reduce header. Packet will not be forwarded!\n");
-    return;
+  // Update path length in header before forward
+  hdr->path_length += 1;
+  // Update hops in header before forward
+  hdr->hops += 1;
+
+  if ((hdr->flags & COLLECT_FLAG_COMPACT_PATH) && !PATH_ENTRY_IS_COMPACT(&linkaddr_node_addr)) {
+    // Slow path: current node address does not fit in a compact entry -> whole path must be re-encoded
+    if (!forward_expand_path(conn, hdr, path_length)) {
+      return;
+    }
+
+  } else {
+    // Fast path: remove only the old header, the path stays in place: [H][D, E, F] -> [D, E, F]
+    int hdr_reduce_res = packetbuf_hdrreduce(sizeof(struct collect_header));
+
+    if (hdr_reduce_res == 0) {
+      conn->stats.drops[MY_COLLECT_DROP_HDRREDUCE]++;
+      TRACE(TRACE_FORWARD_HDRREDUCE_FAILED);
+      return;
+    }
+
+    // Prepend the updated header and the current node address: [D, E, F] -> [H'][A, D, E, F]
+    int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + entry_size);
+
+    if (alloc_res == 0) { // Allocation failed -> report error
+      conn->stats.drops[MY_COLLECT_DROP_HDRALLOC]++;
+      TRACE(TRACE_FORWARD_HDRALLOC_FAILED);
+      return;
+    }
+
+    memcpy(packetbuf_hdrptr(), hdr, sizeof(struct collect_header));
+    path_entry_write(packetbuf_hdrptr() + sizeof(struct collect_header), 0, entry_size, &linkaddr_node_addr);
   }
 
+  if (!forward_to_parent(conn, hdr)) {
+    return; // Not queued -> the pending topology report of the node is still needed
+  }
 
-  // Check if packet is a "dedicated topology report" (it has no data) ->
-  // if true, stop timer used by current node to send its dedicated topology report (it would be redundant)
-  if (packetbuf_datalen() == 0 && ctimer_expired(&dedicated_topology_report_timer) == 0) {
-    ctimer_stop(&dedicated_topology_report_timer);
+#if MY_COLLECT_REPORT_CONTROL
+  // Any forwarded packet carries the <parent, current node> pair in its path
+  report_suppress(conn);
+#else
+  // Forwarded packet is a dedicated topology report ->
+  // stop timer used by current node to send its dedicated topology report (it would be redundant)
+  if (topology_report && ctimer_expired(&conn->topology_report_timer) == 0) {
+    ctimer_stop(&conn->topology_report_timer);
+    conn->stats.topology_reports_suppressed++;
   }
+#endif
+}
 
-  // Rewrite header
-  // + Add current node address to the route path contained in packet
 
-  // Update path length in header before forward
-  hdr->path_length += 1;
-  // Update hops in header before forward
-  hdr->hops += 1;
+/* Multicast commands -----------------------------------------------------------------*/
 
-  // Allocate space in buffer for header and path
-  // header = header + old path array + current node addr
-  int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + (sizeof(linkaddr_t) * hdr->path_length));
+/**
+ * Return the offset of the end of the subtree whose info byte is at "offset"
+ * or -1 if the tree is shorter than declared by its info bytes.
+ */
+static int multicast_tree_skip(const uint8_t *tree, int offset, int length, uint8_t entry_size) {
+  int remaining = 1; // Info bytes still to read
+  bool first = true;
 
-  if (alloc_res == 0) { // Allocation failed -> report error
-    printf("<in_> <packet> <ERROR> Trying to forward a data collection packet but node fails allocating header buffer!\n");
+  while (remaining > 0) {
+    if (!first) {
+      offset += entry_size; // Every info byte except the first one follows the address of its node
+    }
+    first = false;
+
+    if (offset >= length) {
+      return -1;
+    }
+    remaining += (tree[offset] & MULTICAST_TREE_CHILDREN_MASK) - 1;
+    offset++;
+  }
+
+  return offset;
+}
+
+/**
+ * Send a copy of a multicast command to every child of the current node in its routing tree:
+ * each copy carries only the subtree of the child.
+ * "hdr" is the header of the copies, "tree" the routing tree of the current node.
+ * Return the number of copies sent.
+ */
+static int multicast_fanout(struct my_collect_conn *conn, const struct collect_header *hdr,
+  const uint8_t *tree, int tree_length, const uint8_t *payload, int payload_length) {
+
+  uint8_t entry_size = header_entry_size(hdr);
+  int children = tree[0] & MULTICAST_TREE_CHILDREN_MASK;
+  int offset = 1;
+  int sent = 0;
+  int i;
+
+  for (i = 0; i < children; i++) {
+    struct collect_header child_hdr = *hdr;
+    linkaddr_t child;
+    int subtree = offset + entry_size;
+    int end = multicast_tree_skip(tree, subtree, tree_length, entry_size);
+
+    if (end < 0) {
+      conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+      TRACE(TRACE_MULTICAST_TREE_MALFORMED);
+      break;
+    }
+
+    path_entry_read(tree + offset, 0, entry_size, &child);
+    child_hdr.path_length = end - subtree;
+    offset = end;
+
+    packetbuf_clear();
+    packetbuf_copyfrom(payload, payload_length);
+    if (packetbuf_hdralloc(sizeof(struct collect_header) + child_hdr.path_length) == 0) {
+      conn->stats.drops[MY_COLLECT_DROP_HDRALLOC]++;
+      TRACE(TRACE_MULTICAST_HDRALLOC_FAILED, child.u8[0], child.u8[1]);
+      continue;
+    }
+    memcpy(packetbuf_hdrptr(), &child_hdr, sizeof(struct collect_header));
+    memcpy(packetbuf_hdrptr() + sizeof(struct collect_header), tree + subtree, child_hdr.path_length);
+
+    TRACE(TRACE_MULTICAST_COPY_SENT,
+      child.u8[0], child.u8[1], child_hdr.hops, child_hdr.path_length);
+    if (queue_send(conn, &child)) {
+      sent++;
+    }
+  }
+
+  return sent;
+}
+
+/**
+ * Handle the reception of a multicast command: forward a copy to every child in the routing tree,
+ * then deliver the command to the app if the node is a destination.
+ */
+static void handle_recv_multicast_command(struct my_collect_conn *conn, struct collect_header *hdr) {
+  // Copy of the received packet (packetbuf is reused for the copies)
+  uint8_t packet[PACKETBUF_SIZE];
+  uint16_t length = packetbuf_datalen();
+
+  if (hdr->path_length == 0 || length < sizeof(struct collect_header) + hdr->path_length) {
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_MULTICAST_TOO_SHORT, hdr->path_length);
     return;
   }
+  memcpy(packet, packetbuf_dataptr(), length);
 
-  // Overwrite the header present in packet buffer
-  memcpy(packetbuf_hdrptr(), hdr, sizeof(struct collect_header));
-  // Add current node address in packet buffer [_, D, E, F] -> [A, D, E, F]
-  memcpy(packetbuf_hdrptr() + sizeof(struct collect_header), &linkaddr_node_addr, sizeof(linkaddr_t));
-  // Overwrite path in packet (should be unuseful)
-  memcpy(packetbuf_hdrptr() + sizeof(struct collect_header) + sizeof(linkaddr_t), &path, sizeof(linkaddr_t) * path_length);
+  const uint8_t *tree = packet + sizeof(struct collect_header);
+  const uint8_t *payload = tree + hdr->path_length;
+  int payload_length = length - sizeof(struct collect_header) - hdr->path_length;
 
-  // Forward the packet to parent
-  unicast_send(&conn->uc, &conn->parent);
-  printf("<in_> <packet> Packet forwarded to %02x:%02x (current hops: %u)\n", conn->parent.u8[0], conn->parent.u8[1], hdr->hops);
+  struct collect_header forward_hdr = *hdr;
+  forward_hdr.hops += 1;
+  if (multicast_fanout(conn, &forward_hdr, tree, hdr->path_length, payload, payload_length) > 0) {
+    conn->stats.data_forwarded++;
+  }
+
+  if (tree[0] & MULTICAST_TREE_DEST) {
+    packetbuf_clear();
+    packetbuf_copyfrom(payload, payload_length);
 
+#if MY_COLLECT_LATENCY
+    latency_record(conn, hdr);
+#endif
+    // Deliver packet to application
+    conn->callbacks->sr_recv(conn, hdr->hops);
+    conn->stats.data_delivered++;
+
+    TRACE(TRACE_MULTICAST_DELIVERED,
+      hdr->source.u8[0], hdr->source.u8[1], hdr->hops);
+  }
 }
 
 
@@ -410,52 +1827,64 @@ void handle_recv_data_collection_packet_node(struct my_collect_conn *conn, struc
  *
  */
 void handle_recv_command_packet(struct my_collect_conn *conn, struct collect_header *hdr, const linkaddr_t *from) {
-    printf("<out> <command> Received packet from %02x:%02x (header hops: %u, header path_length: %d)\n",
+    TRACE(TRACE_COMMAND_RECEIVED,
       from->u8[0], from->u8[1], hdr->hops, hdr->path_length);
 
   // Sink ///////////////////////////////////////
-  if (is_the_sink) {
+  if (conn->is_sink) {
 
-    printf("<in_> <command> <ERROR> Sink received a command packet! It will be discarded\n");
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_COMMAND_AT_SINK);
     return;
 
   // Common node ////////////////////////////////
   } else { // Packet needs to be forwarded to parent
 
-    printf("<out> <command> Received packet to forward from %02x:%02x (current hops: %u, route length: %d)\n",
+    TRACE(TRACE_COMMAND_TO_FORWARD,
       from->u8[0], from->u8[1], hdr->hops, hdr->path_length);
 
 
+    if (hdr->flags & COLLECT_FLAG_MULTICAST) { // Packet has a routing tree instead of a route path
+      handle_recv_multicast_command(conn, hdr);
+      return;
+    }
+
     // Check if this node is the recipient of the packet
     if (hdr->path_length == 0) { // Route path is empty -> current node is the recipient
-      printf("<in_> <command> Command will be delivered to node...\n");
+      TRACE(TRACE_COMMAND_FOR_NODE);
 
       // Remove header
       int hdr_reduce_res = packetbuf_hdrreduce(sizeof(struct collect_header));
 
       if (hdr_reduce_res == 0) {
-        printf("<in_> <command> <ERROR> Fail to reduce header. Command packet will not be delivered to app!\n");
+        conn->stats.drops[MY_COLLECT_DROP_HDRREDUCE]++;
+        TRACE(TRACE_COMMAND_DELIVER_HDRREDUCE_FAILED);
         return;
       }
 
+#if MY_COLLECT_LATENCY
+      latency_record(conn, hdr);
+#endif
       // Deliver packet to application
       conn->callbacks->sr_recv(conn, hdr->hops);
+      conn->stats.data_delivered++;
 
-      printf("<in_> <command> <SUCCESS> Command arrived to the node! (source: %02x:%02x, hops: %u)\n",
+      TRACE(TRACE_COMMAND_DELIVERED,
         hdr->source.u8[0], hdr->source.u8[1], hdr->hops);
 
     } else { // Node is NOT the recipient -> it must forward the packet to the next node
 
       linkaddr_t next_node_addr;
+      uint8_t entry_size = header_entry_size(hdr);
       // Extract next node from route path attached to packet header
-      // memcpy(packetbuf_dataptr() + sizeof(struct collect_header), &next_node_addr, sizeof(linkaddr_t));
-      memcpy(&next_node_addr, packetbuf_dataptr() + sizeof(struct collect_header), sizeof(linkaddr_t));
+      path_entry_read(packetbuf_dataptr() + sizeof(struct collect_header), 0, entry_size, &next_node_addr);
 
       // Resize the packet buffer removing size of the extracted node address
-      int hdr_reduce_res = packetbuf_hdrreduce(sizeof(linkaddr_t));
+      int hdr_reduce_res = packetbuf_hdrreduce(entry_size);
 
       if (hdr_reduce_res == 0) {
-        printf("<out> <command> <ERROR> Fail to reduce header. Command packet will not be forwarded to the next node!\n");
+        conn->stats.drops[MY_COLLECT_DROP_HDRREDUCE]++;
+        TRACE(TRACE_COMMAND_FORWARD_HDRREDUCE_FAILED);
         return;
       }
 
@@ -467,8 +1896,9 @@ void handle_recv_command_packet(struct my_collect_conn *conn, struct collect_hea
       memcpy(packetbuf_dataptr(), hdr, sizeof(struct collect_header));
 
       // Forward the packet to next node
-      unicast_send(&conn->uc, &next_node_addr);
-      printf("<out> <command> Packet forwarded to %02x:%02x (current hops: %u, route length: %d)\n",
+      queue_send(conn, &next_node_addr);
+      conn->stats.data_forwarded++;
+      TRACE(TRACE_COMMAND_FORWARDED,
         next_node_addr.u8[0], next_node_addr.u8[1], hdr->hops, hdr->path_length);
     }
 
@@ -482,75 +1912,409 @@ void handle_recv_command_packet(struct my_collect_conn *conn, struct collect_hea
 
 
 // Send command function
-int sr_send(struct my_collect_conn *conn, const linkaddr_t *dest) {
-  printf("<out> <command> Try to send command packet to %02x:%02x ...\n", dest->u8[0], dest->u8[1]);
-
+/**
+ * Source route the command in packetbuf to dest.
+ * Return -1 if the route is not known, otherwise the result of the send (zero if it failed).
+ */
+static int sr_send_routed(struct my_collect_conn *conn, const linkaddr_t *dest) {
   // Prepare header
   // is_command=true -> this is a sink to node packet (one-to-many)
-  struct collect_header hdr = {.source=linkaddr_node_addr, .hops=0, .is_command=true, .path_length=0};
+  struct collect_header hdr = {.source=linkaddr_node_addr, .hops=0, .seqn=conn->packet_seqn++, .is_command=true,
+    .path_length=0, .flags=0};
 
-  // Create the route path to attach to the packet to help nodes to forward the packet
-  struct source_route route = routing_table_find_route_path(dest);
+  // Compute the length of the route path to attach to the packet to help nodes to forward the packet
+  int route_length = routing_table_route_length(conn->routing_table, dest);
 
   // Check for errors or detected loops
-  if (route.route == NULL) {
-    printf("<out> <command> <ERROR> Cannot send command since source routing path cannot be created (loop detected or missing info)!\n");
-    return 0;
+  if (route_length <= 0) {
+    TRACE(TRACE_COMMAND_NO_ROUTE);
+    return -1;
   }
 
-  // Ok, build routing path array
-
-  // Create path array (-1 to exclude first node from path -> sink will directly send packet to first node)
-  uint8_t path_length = route.length - 1;
-  linkaddr_t path[path_length];
-  // First node to which the sink will send the packet
-  linkaddr_t next_node = route.route[0];
+  // Path length in header (-1 to exclude first node from path -> sink will directly send packet to first node)
+  hdr.path_length = route_length - 1;
 
-  // Fill routing path excluding first node
-  int i = 0;
-  for (i = 0; i < path_length; i++) {
-    path[i] = route.route[i + 1];
+  // Every node of the route is in the routing table -> route is compact if the whole table is
+  if (MY_COLLECT_COMPACT_PATH && routing_table_is_compact(conn->routing_table)) {
+    hdr.flags |= COLLECT_FLAG_COMPACT_PATH;
   }
-
-  // Route is no more needed
-  free(route.route);
-
-  // Update path length in header
-  hdr.path_length = path_length;
+  uint8_t entry_size = header_entry_size(&hdr);
 
   // Try to allocate space for header
-  int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + (sizeof(linkaddr_t) * path_length)); // header + path array
+  int alloc_res = packetbuf_hdralloc(sizeof(struct collect_header) + (entry_size * hdr.path_length)); // header + path array
 
   if (alloc_res == 0) { // Allocation failed -> report error
-    printf("<out> <command> <ERROR> Trying to send a command packet but node fails allocating header buffer!\n");
+    conn->stats.drops[MY_COLLECT_DROP_HDRALLOC]++;
+    TRACE(TRACE_COMMAND_HDRALLOC_FAILED);
     return 0;
   }
 
-  // Add header to packet
+  // Write the route directly into the header area. The route starts one entry before the path array
+  // so that route[0] (the first node, not part of the path) temporarily lands on the header bytes:
+  // [ header ... | route[0] ][ route[1] ... route[n - 1] ]
+  uint8_t *route = (uint8_t *)packetbuf_hdrptr() + sizeof(struct collect_header) - entry_size;
+
+  if (routing_table_find_route_path(conn->routing_table, dest, route, route_length, entry_size) < 0) {
+    TRACE(TRACE_COMMAND_ROUTE_FAILED);
+    return -1;
+  }
+
+  // First node to which the sink will send the packet
+  linkaddr_t next_node;
+  path_entry_read(route, 0, entry_size, &next_node);
+
+  // Add header to packet (overwrite route[0])
   memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct collect_header));
-  // Add current node to path array after the header
-  memcpy(packetbuf_hdrptr() + sizeof(struct collect_header), &path, sizeof(linkaddr_t) * path_length);
   // Send packet to next node and report success
 
-  printf("<out> <command> Send command packet (dest: %02x:%02x, path_length: %d)\n", dest->u8[0], dest->u8[1], hdr.path_length);
+  TRACE(TRACE_COMMAND_SENT, dest->u8[0], dest->u8[1], hdr.path_length);
 
-  int res = unicast_send(&conn->uc, &next_node);
+  int res = queue_send(conn, &next_node);
 
   return res;
 }
 
+int sr_send(struct my_collect_conn *conn, const linkaddr_t *dest) {
+  TRACE(TRACE_COMMAND_SEND_TRY, dest->u8[0], dest->u8[1]);
+  conn->stats.data_originated++;
+
+  int res = sr_send_routed(conn, dest);
+
+  if (res >= 0) {
+    return res;
+  }
+#if MY_COLLECT_ROUTE_DISCOVERY
+  // Route not known -> keep the command until the route is discovered
+  if (rreq_start(conn, dest)) {
+    return 1;
+  }
+#endif
+  conn->stats.drops[MY_COLLECT_DROP_NO_ROUTE]++;
+  return 0;
+}
+
+
+// Node of the routing tree of a multicast command (built by the sink)
+struct multicast_node {
+  linkaddr_t addr;
+  uint8_t parent; // Index of the parent node (0 is the sink)
+  uint8_t info;   // MULTICAST_TREE_* info byte
+};
+
+// Compile-time check: the copies of a multicast command carry the routing tree in the packet header
+typedef char multicast_tree_fits_header[
+  (sizeof(struct collect_header) + MULTICAST_TREE_MAX_CARRIED <= PACKETBUF_HDR_SIZE) ? 1 : -1];
+
+// Send command function (several destinations)
+int sr_send_multi(struct my_collect_conn *conn, const linkaddr_t *dests, int n) {
+  // Scratch buffers on the stack, only for the duration of the call (node 0 of the tree is the sink)
+  struct multicast_node nodes[MY_COLLECT_MULTICAST_MAX_NODES + 1];
+  uint8_t stack[MY_COLLECT_MULTICAST_MAX_NODES + 1];
+  linkaddr_t route[ROUTING_TABLE_MAX_ROUTE_LENGTH];
+  uint8_t tree[MULTICAST_TREE_MAX_LENGTH];
+  uint8_t payload[PACKETBUF_SIZE];
+
+  struct collect_header hdr = {.source=linkaddr_node_addr, .hops=0, .seqn=conn->packet_seqn++, .is_command=true,
+    .path_length=0, .flags=COLLECT_FLAG_MULTICAST};
+  int count = 1;
+  int reached = 0;
+  int d, i, j;
+
+  TRACE(TRACE_MULTICAST_SEND_TRY, n);
+
+  // Every destination is a node of the routing tree
+  if (n > MY_COLLECT_MULTICAST_MAX_NODES) {
+    TRACE(TRACE_MULTICAST_TOO_MANY_DESTINATIONS, n, MY_COLLECT_MULTICAST_MAX_NODES);
+    return 0;
+  }
+  conn->stats.data_originated++;
+
+  linkaddr_copy(&nodes[0].addr, &linkaddr_node_addr);
+  nodes[0].info = 0;
+
+  // Merge the route of every destination into the routing tree
+  for (d = 0; d < n; d++) {
+    int route_length = routing_table_route_length(conn->routing_table, &dests[d]);
+
+    if (route_length <= 0 ||
+        routing_table_find_route_path(conn->routing_table, &dests[d], route, route_length, PATH_ENTRY_SIZE_FULL) < 0) {
+      conn->stats.drops[MY_COLLECT_DROP_NO_ROUTE]++;
+      TRACE(TRACE_MULTICAST_NO_ROUTE, dests[d].u8[0], dests[d].u8[1]);
+      continue;
+    }
+
+    // Follow the part of the route already in the tree
+    uint8_t current = 0;
+    for (i = 0; i < route_length; i++) {
+      for (j = current + 1; j < count; j++) {
+        if (nodes[j].parent == current && linkaddr_cmp(&nodes[j].addr, &route[i])) {
+          break;
+        }
+      }
+      if (j == count) {
+        break; // Routes diverge here
+      }
+      current = j;
+    }
+
+    // Whole route already in the tree and ending at a destination -> listed twice, counted once
+    if (i == route_length && (nodes[current].info & MULTICAST_TREE_DEST)) {
+      TRACE(TRACE_MULTICAST_DUPLICATE_DESTINATION, dests[d].u8[0], dests[d].u8[1]);
+      continue;
+    }
+
+    if (count + (route_length - i) > MY_COLLECT_MULTICAST_MAX_NODES + 1) {
+      conn->stats.drops[MY_COLLECT_DROP_NO_ROUTE]++;
+      TRACE(TRACE_MULTICAST_TREE_FULL,
+        dests[d].u8[0], dests[d].u8[1]);
+      continue;
+    }
+
+    // Append the rest of the route
+    for (; i < route_length; i++) {
+      linkaddr_copy(&nodes[count].addr, &route[i]);
+      nodes[count].parent = current;
+      nodes[count].info = 0;
+      nodes[current].info++;
+      current = count++;
+    }
+
+    nodes[current].info |= MULTICAST_TREE_DEST;
+    reached++;
+  }
+
+  if (reached == 0) {
+    TRACE(TRACE_MULTICAST_NO_DESTINATION);
+    return 0;
+  }
+
+  // Every node of the tree is in the routing table -> tree is compact if the whole table is
+  if (MY_COLLECT_COMPACT_PATH && routing_table_is_compact(conn->routing_table)) {
+    hdr.flags |= COLLECT_FLAG_COMPACT_PATH;
+  }
+  uint8_t entry_size = header_entry_size(&hdr);
+
+  // Write the tree in preorder (children in insertion order): <address, info> pairs, the sink has only the info
+  int tree_length = 0;
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    uint8_t index = stack[--top];
+
+    if (index != 0) {
+      path_entry_write(tree + tree_length, 0, entry_size, &nodes[index].addr);
+      tree_length += entry_size;
+    }
+    tree[tree_length++] = nodes[index].info;
+
+    for (j = count - 1; j > index; j--) {
+      if (nodes[j].parent == index) {
+        stack[top++] = j;
+      }
+    }
+  }
+
+  // Payload is the current content of packetbuf
+  int payload_length = packetbuf_datalen();
+  memcpy(payload, packetbuf_dataptr(), payload_length);
+
+  TRACE(TRACE_MULTICAST_SENT,
+    reached, count - 1, tree_length);
+
+  if (multicast_fanout(conn, &hdr, tree, tree_length, payload, payload_length) == 0) {
+    return 0;
+  }
+  return reached;
+}
+
+
+/* Route discovery --------------------------------------------------------------------*/
+
+#if MY_COLLECT_ROUTE_DISCOVERY
+struct route_request { // Route request message structure (flooded from the sink)
+  uint8_t seqn;
+  // Hops the request can still travel
+  uint8_t hops_left;
+  // Node that must reply with a topology report
+  linkaddr_t target;
+} __attribute__((packed));
+
+static void rreq_send(struct my_collect_conn *conn, uint8_t seqn, uint8_t hops_left, const linkaddr_t *target) {
+  struct route_request request = {.seqn = seqn, .hops_left = hops_left, .target = *target};
+
+  packetbuf_clear();
+  packetbuf_copyfrom(&request, sizeof(request));
+  broadcast_send(&conn->rreq_bc);
+}
+
+/**
+ * Return the node whose parent is missing in the route to dest (ie: the node whose topology report
+ * completes the route), dest itself if the parents are chained in a loop.
+ */
+static linkaddr_t rreq_target(struct my_collect_conn *conn, const linkaddr_t *dest) {
+  linkaddr_t node = *dest;
+  int i;
+
+  for (i = 0; i < ROUTING_TABLE_MAX_ROUTE_LENGTH; i++) {
+    linkaddr_t parent = routing_table_get_parent(conn->routing_table, node);
+
+    if (linkaddr_cmp(&parent, &linkaddr_null)) {
+      return node;
+    }
+    if (linkaddr_cmp(&parent, &linkaddr_node_addr)) {
+      break; // Route is complete (loop found by the route computation)
+    }
+    node = parent;
+  }
+  return *dest;
+}
+
+// Sink: flood the next request for the pending command, drop it if there are no requests left
+static void rreq_request(struct my_collect_conn *conn) {
+  if (conn->pending_requests == MY_COLLECT_ROUTE_REQUEST_MAX) {
+    conn->stats.drops[MY_COLLECT_DROP_NO_ROUTE]++;
+    TRACE(TRACE_ROUTE_DISCOVERY_FAILED,
+      conn->pending_dest.u8[0], conn->pending_dest.u8[1], conn->pending_requests);
+    linkaddr_copy(&conn->pending_dest, &linkaddr_null);
+    return;
+  }
+
+  conn->rreq_target = rreq_target(conn, &conn->pending_dest);
+  conn->rreq_seqn++;
+  conn->pending_requests++;
+  TRACE(TRACE_ROUTE_REQUEST_SENT, conn->rreq_seqn, conn->pending_dest.u8[0], conn->pending_dest.u8[1],
+    conn->rreq_target.u8[0], conn->rreq_target.u8[1], conn->pending_requests);
+
+  rreq_send(conn, conn->rreq_seqn, MY_COLLECT_ROUTE_REQUEST_SCOPE, &conn->rreq_target);
+  ctimer_set(&conn->rreq_timer, MY_COLLECT_ROUTE_REQUEST_TIMEOUT, rreq_timer_cb, conn);
+}
+
+// Sink: buffer the command in packetbuf and start the discovery of the route to dest
+static bool rreq_start(struct my_collect_conn *conn, const linkaddr_t *dest) {
+  if (!linkaddr_cmp(&conn->pending_dest, &linkaddr_null)) {
+    TRACE(TRACE_COMMAND_PENDING_BUSY,
+      dest->u8[0], dest->u8[1], conn->pending_dest.u8[0], conn->pending_dest.u8[1]);
+    return false;
+  }
+
+  linkaddr_copy(&conn->pending_dest, dest);
+  conn->pending_requests = 0;
+  conn->pending_length = packetbuf_datalen();
+  memcpy(conn->pending_data, packetbuf_dataptr(), conn->pending_length);
+  TRACE(TRACE_COMMAND_PENDING, dest->u8[0], dest->u8[1]);
+
+  rreq_request(conn);
+  return true;
+}
+
+// Sink: send the pending command if its route is complete now, otherwise request the route again
+static void rreq_timer_cb(void *ptr) {
+  struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
+  linkaddr_t dest = conn->pending_dest;
+
+  if (linkaddr_cmp(&dest, &linkaddr_null)) {
+    return;
+  }
+
+  if (routing_table_route_length(conn->routing_table, &dest) <= 0) {
+    rreq_request(conn);
+    return;
+  }
+
+  ctimer_stop(&conn->rreq_timer);
+  linkaddr_copy(&conn->pending_dest, &linkaddr_null);
+  TRACE(TRACE_ROUTE_DISCOVERED, dest.u8[0], dest.u8[1], conn->pending_requests);
+
+  packetbuf_clear();
+  packetbuf_copyfrom(conn->pending_data, conn->pending_length);
+  if (sr_send_routed(conn, &dest) < 0) {
+    conn->stats.drops[MY_COLLECT_DROP_NO_ROUTE]++;
+  }
+}
+
+// Sink: a packet of the node asked to complete the route has been received
+static void rreq_heard(struct my_collect_conn *conn, const linkaddr_t *source) {
+  if (!linkaddr_cmp(&conn->pending_dest, &linkaddr_null) && linkaddr_cmp(source, &conn->rreq_target) &&
+      routing_table_route_length(conn->routing_table, &conn->pending_dest) > 0) {
+    // Route is complete -> send the command out of the reception (packetbuf is in use)
+    ctimer_set(&conn->rreq_timer, 0, rreq_timer_cb, conn);
+  }
+}
+
+// Nodes: rebroadcast the last request heard
+static void rreq_forward_cb(void *ptr) {
+  struct my_collect_conn *conn = (struct my_collect_conn *)ptr;
+
+  TRACE(TRACE_ROUTE_REQUEST_FORWARDED, conn->rreq_seqn,
+    conn->rreq_target.u8[0], conn->rreq_target.u8[1], conn->rreq_hops_left);
+  rreq_send(conn, conn->rreq_seqn, conn->rreq_hops_left, &conn->rreq_target);
+}
+
+// Route request receive callback
+static void rreq_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender) {
+  struct route_request request;
+  // Get the pointer to the overall structure my_collect_conn from its field rreq_bc
+  struct my_collect_conn* conn = (struct my_collect_conn*)(((uint8_t*)bc_conn) - offsetof(struct my_collect_conn, rreq_bc));
+
+  if (packetbuf_datalen() != sizeof(struct route_request)) {
+    conn->stats.drops[MY_COLLECT_DROP_MALFORMED]++;
+    TRACE(TRACE_ROUTE_REQUEST_WRONG_SIZE);
+    return;
+  }
+  memcpy(&request, packetbuf_dataptr(), sizeof(struct route_request));
+  // Aligned copy of the target (request is packed)
+  linkaddr_t target = request.target;
+
+  if (conn->is_sink) { // The sink ignores its own requests
+    return;
+  }
+  // Every request is handled once. The last seqn is forgotten after MY_COLLECT_ROUTE_REQUEST_TIMEOUT
+  // (every copy of a request is heard before the sink repeats it), so the requests of a rebooted sink
+  // (seqn restarted from 0) are not taken for old ones
+  if (conn->rreq_heard) {
+    clock_time_t elapsed = clock_time() - conn->rreq_time;
+
+    if (elapsed < MY_COLLECT_ROUTE_REQUEST_TIMEOUT && (int8_t)(request.seqn - conn->rreq_seqn) <= 0) {
+      return;
+    }
+  }
+  conn->rreq_heard = true;
+  conn->rreq_seqn = request.seqn;
+  conn->rreq_time = clock_time();
+
+  if (linkaddr_cmp(&target, &linkaddr_node_addr)) {
+    // Reply with a dedicated topology report: the sink learns the route while it goes up
+    packetbuf_clear();
+    packetbuf_set_datalen(0);
+    int res = my_collect_send(conn);
+    if (res) {
+      conn->stats.topology_reports_sent++;
+    }
+    TRACE(TRACE_ROUTE_REQUEST_REPLIED, request.seqn, sender->u8[0], sender->u8[1], res);
+    return;
+  }
+
+  if (request.hops_left > 1) {
+    // Rebroadcast after a short random delay (avoid collisions with the other forwarders)
+    linkaddr_copy(&conn->rreq_target, &target);
+    conn->rreq_hops_left = request.hops_left - 1;
+    ctimer_set(&conn->rreq_timer, ROUTE_REQUEST_FORWARD_DELAY, rreq_forward_cb, conn);
+  }
+}
+#endif
 
 
 /* Sink -------------------------------------------------------------------------------*/
 
 void initialize_sink(struct my_collect_conn* conn) {
-    printf("<open> Node is the sink (node: %02x:%02x).\n", linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+    TRACE(TRACE_OPEN_SINK, linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
 
     // Sink has 0 as metric
     conn->metric = 0;
+    conn->path_etx = 0;
 
     // Initialize routing table
-    routing_table_init();
+    routing_table_init(conn->routing_table);
 
     // Params
     // c	A pointer to the callback timer.
@@ -558,7 +2322,19 @@ void initialize_sink(struct my_collect_conn* conn) {
     // f	A function to be called when the timer expires.
     // ptr	An opaque pointer that will be supplied as an argument to the callback function.
 
-    // Send first beacon and then setup timer
-    beacon_timer_cb(conn);
+    // Send first beacon (with a new seqn) and then setup timer
+    conn->beacon_seqn = conn->beacon_seqn + 1;
+    trickle_reset(conn);
     ctimer_set(&conn->beacon_timer, BEACON_INTERVAL, beacon_timer_cb, conn);
+
+#if ROUTING_TABLE_EXPORT
+    ctimer_set(&conn->snapshot_timer, ROUTING_TABLE_SNAPSHOT_PERIOD, snapshot_timer_cb, conn);
+#endif
+
+#if MY_COLLECT_STAGGER
+    // The cycle of the sink is the time reference of the tree
+    conn->stagger_cycle_start = clock_time();
+    conn->stagger_synced = true;
+    stagger_schedule(conn);
+#endif
 }
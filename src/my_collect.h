@@ -6,17 +6,458 @@
 #include "core/net/linkaddr.h"
 #include "net/netstack.h"
 #include "net/rime/rime.h"
+#include "my_neighbor_table.h"
+#include "my_routing_table.h"
+
+/* Config -----------------------------------------------------------------------------*/
+
+/* Write path arrays with 1 byte per node (see COLLECT_FLAG_COMPACT_PATH) when possible */
+#ifdef MY_COLLECT_CONF_COMPACT_PATH
+#define MY_COLLECT_COMPACT_PATH MY_COLLECT_CONF_COMPACT_PATH
+#else
+#define MY_COLLECT_COMPACT_PATH 1
+#endif
+
+/* How nodes inform the sink about the topology:
+ *  - MY_COLLECT_TOPOLOGY_PIGGYBACK_PATH: every upward packet carries the whole path (source -> sink)
+ *  - MY_COLLECT_TOPOLOGY_PARENT_REPORT:  every upward packet carries only the <parent, source> pair
+ *    of its source and the source topology epoch (constant size, see struct parent_report) */
+#define MY_COLLECT_TOPOLOGY_PIGGYBACK_PATH 0
+#define MY_COLLECT_TOPOLOGY_PARENT_REPORT  1
+
+#ifdef MY_COLLECT_CONF_TOPOLOGY_MODE
+#define MY_COLLECT_TOPOLOGY_MODE MY_COLLECT_CONF_TOPOLOGY_MODE
+#else
+#define MY_COLLECT_TOPOLOGY_MODE MY_COLLECT_TOPOLOGY_PIGGYBACK_PATH
+#endif
+
+/* Trickle beacon scheduling: the beacon interval starts from MY_COLLECT_TRICKLE_IMIN and doubles
+ * (up to MY_COLLECT_TRICKLE_IMAX) while the tree is consistent. A beacon is suppressed if at least
+ * MY_COLLECT_TRICKLE_K consistent beacons have been heard in the current interval. The new seqn of
+ * the periodic refresh of the sink is not an inconsistency: every node forwards it once */
+#ifdef MY_COLLECT_CONF_TRICKLE_IMIN
+#define MY_COLLECT_TRICKLE_IMIN MY_COLLECT_CONF_TRICKLE_IMIN
+#else
+#define MY_COLLECT_TRICKLE_IMIN CLOCK_SECOND
+#endif
+
+#ifdef MY_COLLECT_CONF_TRICKLE_IMAX
+#define MY_COLLECT_TRICKLE_IMAX MY_COLLECT_CONF_TRICKLE_IMAX
+#else
+#define MY_COLLECT_TRICKLE_IMAX (CLOCK_SECOND * 64)
+#endif
+
+#ifdef MY_COLLECT_CONF_TRICKLE_K
+#define MY_COLLECT_TRICKLE_K MY_COLLECT_CONF_TRICKLE_K
+#else
+#define MY_COLLECT_TRICKLE_K 2
+#endif
+
+/* A node switches to a new parent only if its path cost (ETX) is lower than the cost of the
+ * current parent by at least this value plus MY_COLLECT_PARENT_SWITCH_MARGIN percent of the cost of
+ * the current parent (avoid flapping between parents with similar cost: link ETX noise grows with
+ * the path). Parents are evaluated at every beacon received, and the same margin applies to the
+ * path cost changes advertised in beacons */
+#ifdef MY_COLLECT_CONF_PARENT_SWITCH_THRESHOLD
+#define MY_COLLECT_PARENT_SWITCH_THRESHOLD MY_COLLECT_CONF_PARENT_SWITCH_THRESHOLD
+#else
+#define MY_COLLECT_PARENT_SWITCH_THRESHOLD (ETX_SCALE / 2)
+#endif
+
+#ifdef MY_COLLECT_CONF_PARENT_SWITCH_MARGIN
+#define MY_COLLECT_PARENT_SWITCH_MARGIN MY_COLLECT_CONF_PARENT_SWITCH_MARGIN
+#else
+#define MY_COLLECT_PARENT_SWITCH_MARGIN 20
+#endif
+
+/* Max number of backup parents tried for a packet not acknowledged by the parent */
+#ifdef MY_COLLECT_CONF_MAX_FAILOVERS
+#define MY_COLLECT_MAX_FAILOVERS MY_COLLECT_CONF_MAX_FAILOVERS
+#else
+#define MY_COLLECT_MAX_FAILOVERS 2
+#endif
+
+/* Unicast packets (own, forwarded and commands) are sent one at a time from a per-connection
+ * queue of at most MY_COLLECT_QUEUE_SIZE packets. A packet not acknowledged by the next hop (or
+ * that the MAC layer could not send) is retransmitted up to MY_COLLECT_MAX_RETRIES times, after a
+ * random backoff between MY_COLLECT_RETRY_BACKOFF and twice that, doubled at every retry */
+#ifdef MY_COLLECT_CONF_QUEUE_SIZE
+#define MY_COLLECT_QUEUE_SIZE MY_COLLECT_CONF_QUEUE_SIZE
+#else
+#define MY_COLLECT_QUEUE_SIZE 4
+#endif
+
+#ifdef MY_COLLECT_CONF_MAX_RETRIES
+#define MY_COLLECT_MAX_RETRIES MY_COLLECT_CONF_MAX_RETRIES
+#else
+#define MY_COLLECT_MAX_RETRIES 3
+#endif
+
+#ifdef MY_COLLECT_CONF_RETRY_BACKOFF
+#define MY_COLLECT_RETRY_BACKOFF MY_COLLECT_CONF_RETRY_BACKOFF
+#else
+#define MY_COLLECT_RETRY_BACKOFF (CLOCK_SECOND / 32)
+#endif
+
+/* Number of (source, seqn) pairs of recently received packets remembered to drop duplicates
+ * (retransmissions of packets whose ACK has been lost) */
+#ifdef MY_COLLECT_CONF_DUPLICATE_CACHE_SIZE
+#define MY_COLLECT_DUPLICATE_CACHE_SIZE MY_COLLECT_CONF_DUPLICATE_CACHE_SIZE
+#else
+#define MY_COLLECT_DUPLICATE_CACHE_SIZE 8
+#endif
+
+/* Max number of nodes (destinations and forwarders, sink excluded) of the routing tree of a
+ * command sent to several destinations (see sr_send_multi()). The tree travels in the packet header,
+ * so the encoded tree of this many nodes must fit in PACKETBUF_HDR_SIZE with the collect header */
+#ifdef MY_COLLECT_CONF_MULTICAST_MAX_NODES
+#define MY_COLLECT_MULTICAST_MAX_NODES MY_COLLECT_CONF_MULTICAST_MAX_NODES
+#else
+#define MY_COLLECT_MULTICAST_MAX_NODES 12
+#endif
+
+/* Batching of forwarded packets: a forwarder holds upward packets for MY_COLLECT_BATCH_WINDOW
+ * and sends them to the parent in a single frame of at most MY_COLLECT_BATCH_SIZE bytes */
+#ifdef MY_COLLECT_CONF_BATCHING
+#define MY_COLLECT_BATCHING MY_COLLECT_CONF_BATCHING
+#else
+#define MY_COLLECT_BATCHING 0
+#endif
+
+#ifdef MY_COLLECT_CONF_BATCH_WINDOW
+#define MY_COLLECT_BATCH_WINDOW MY_COLLECT_CONF_BATCH_WINDOW
+#else
+#define MY_COLLECT_BATCH_WINDOW (CLOCK_SECOND / 4)
+#endif
+
+#ifdef MY_COLLECT_CONF_BATCH_SIZE
+#define MY_COLLECT_BATCH_SIZE MY_COLLECT_CONF_BATCH_SIZE
+#else
+#define MY_COLLECT_BATCH_SIZE 96
+#endif
+
+/* Statistics reports: every MY_COLLECT_STATS_REPORT_INTERVAL a node attaches a snapshot of its
+ * counters to its next upward packet (or sends it alone if it has sent nothing for a whole interval) */
+#ifdef MY_COLLECT_CONF_STATS_REPORT
+#define MY_COLLECT_STATS_REPORT MY_COLLECT_CONF_STATS_REPORT
+#else
+#define MY_COLLECT_STATS_REPORT 0
+#endif
+
+#ifdef MY_COLLECT_CONF_STATS_REPORT_INTERVAL
+#define MY_COLLECT_STATS_REPORT_INTERVAL MY_COLLECT_CONF_STATS_REPORT_INTERVAL
+#else
+#define MY_COLLECT_STATS_REPORT_INTERVAL (CLOCK_SECOND * 60 * 5)
+#endif
+
+/* Latency measurement: packets carry the time spent in the queues of the nodes of their path and its
+ * shortest and longest value at a single node (collect_header.delay, hop_delay_*). The sink (data
+ * packets) and the destinations (commands) expose the delays of the packet delivered to the
+ * recv/sr_recv callbacks and keep a histogram of the total delays */
+#ifdef MY_COLLECT_CONF_LATENCY
+#define MY_COLLECT_LATENCY MY_COLLECT_CONF_LATENCY
+#else
+#define MY_COLLECT_LATENCY 0
+#endif
+
+#define MY_COLLECT_LATENCY_BUCKETS 14
+
+/* Depth-staggered slots for duty-cycled MACs: time is divided in cycles of MY_COLLECT_STAGGER_PERIOD,
+ * aligned to the sink with the cycle phase carried in beacons. A node at depth d (its metric) sends
+ * its upward packets only in slot MY_COLLECT_STAGGER_MAX_DEPTH - d of the cycle, and keeps the
+ * radio on from the slot of its children to the end of its own one (while it has active children),
+ * so that a packet ripples from the leaves to the sink within one cycle instead of waiting for a
+ * wake-up of the receiver at every hop. Slots must fit the period:
+ * (MY_COLLECT_STAGGER_MAX_DEPTH + 1) * MY_COLLECT_STAGGER_SLOT <= MY_COLLECT_STAGGER_PERIOD.
+ * Packets waiting for the slot use the queue: MY_COLLECT_QUEUE_SIZE must hold the packets of
+ * a cycle (or use MY_COLLECT_BATCHING).
+ * Listening switches the duty cycling of the whole node (NETSTACK_RDC.off()/on() are not reference
+ * counted): a node must open at most one connection with staggered slots, otherwise the first
+ * connection that stops listening turns the duty cycling back on under the others */
+#ifdef MY_COLLECT_CONF_STAGGER
+#define MY_COLLECT_STAGGER MY_COLLECT_CONF_STAGGER
+#else
+#define MY_COLLECT_STAGGER 0
+#endif
+
+#ifdef MY_COLLECT_CONF_STAGGER_PERIOD
+#define MY_COLLECT_STAGGER_PERIOD MY_COLLECT_CONF_STAGGER_PERIOD
+#else
+#define MY_COLLECT_STAGGER_PERIOD (CLOCK_SECOND * 16)
+#endif
+
+#ifdef MY_COLLECT_CONF_STAGGER_SLOT
+#define MY_COLLECT_STAGGER_SLOT MY_COLLECT_CONF_STAGGER_SLOT
+#else
+#define MY_COLLECT_STAGGER_SLOT (CLOCK_SECOND / 8)
+#endif
+
+/* Nodes at this depth and deeper share the first slot of the cycle (slot 0, reserved for them):
+ * a parent at depth >= MY_COLLECT_STAGGER_MAX_DEPTH listens in it as its own slot, so a packet
+ * crosses these hops only while the slot lasts and waits for the next cycle at the first hop
+ * that misses it */
+#ifdef MY_COLLECT_CONF_STAGGER_MAX_DEPTH
+#define MY_COLLECT_STAGGER_MAX_DEPTH MY_COLLECT_CONF_STAGGER_MAX_DEPTH
+#else
+#define MY_COLLECT_STAGGER_MAX_DEPTH 16
+#endif
+
+/* A node stops listening in the slot of its children after this many cycles without upward packets */
+#ifdef MY_COLLECT_CONF_STAGGER_IDLE_CYCLES
+#define MY_COLLECT_STAGGER_IDLE_CYCLES MY_COLLECT_CONF_STAGGER_IDLE_CYCLES
+#else
+#define MY_COLLECT_STAGGER_IDLE_CYCLES 4
+#endif
+
+/* Rate control of the dedicated topology reports sent after a parent change:
+ *  - a pending report is skipped if an upward packet carrying the new parent of the node (an own
+ *    packet, or a forwarded one when paths are piggybacked) is sent before it is due
+ *  - the report delay doubles (up to MY_COLLECT_REPORT_MAX_BACKOFF times, at most
+ *    MY_COLLECT_REPORT_MAX_DELAY) at every parent change within MY_COLLECT_REPORT_CHURN_WINDOW
+ *    from the previous one, and is back to normal after a quiet window
+ *  - reports are limited by a token bucket of MY_COLLECT_REPORT_BURST tokens, refilled with one
+ *    token every MY_COLLECT_REPORT_PERIOD seconds (a report without tokens waits for the next one)
+ * Period and burst are the defaults of the sink, that advertises them in beacons to the whole
+ * network (see my_collect_report_control_set()) */
+#ifdef MY_COLLECT_CONF_REPORT_CONTROL
+#define MY_COLLECT_REPORT_CONTROL MY_COLLECT_CONF_REPORT_CONTROL
+#else
+#define MY_COLLECT_REPORT_CONTROL 0
+#endif
+
+#ifdef MY_COLLECT_CONF_REPORT_PERIOD
+#define MY_COLLECT_REPORT_PERIOD MY_COLLECT_CONF_REPORT_PERIOD
+#else
+#define MY_COLLECT_REPORT_PERIOD 30
+#endif
+
+#ifdef MY_COLLECT_CONF_REPORT_BURST
+#define MY_COLLECT_REPORT_BURST MY_COLLECT_CONF_REPORT_BURST
+#else
+#define MY_COLLECT_REPORT_BURST 2
+#endif
+
+#ifdef MY_COLLECT_CONF_REPORT_CHURN_WINDOW
+#define MY_COLLECT_REPORT_CHURN_WINDOW MY_COLLECT_CONF_REPORT_CHURN_WINDOW
+#else
+#define MY_COLLECT_REPORT_CHURN_WINDOW (CLOCK_SECOND * 60)
+#endif
+
+#ifdef MY_COLLECT_CONF_REPORT_MAX_BACKOFF
+#define MY_COLLECT_REPORT_MAX_BACKOFF MY_COLLECT_CONF_REPORT_MAX_BACKOFF
+#else
+#define MY_COLLECT_REPORT_MAX_BACKOFF 3
+#endif
+
+#ifdef MY_COLLECT_CONF_REPORT_MAX_DELAY
+#define MY_COLLECT_REPORT_MAX_DELAY MY_COLLECT_CONF_REPORT_MAX_DELAY
+#else
+#define MY_COLLECT_REPORT_MAX_DELAY (CLOCK_SECOND * 120)
+#endif
+
+/* On-demand route discovery: when the sink has no route to the destination of a command, the
+ * command is buffered and a route request is flooded (on channel C+2) up to
+ * MY_COLLECT_ROUTE_REQUEST_SCOPE hops. The node where the known route breaks (the destination
+ * itself if it is not known at all) replies with a dedicated topology report, and the command is
+ * sent as soon as the route is complete. Requests are repeated every MY_COLLECT_ROUTE_REQUEST_TIMEOUT
+ * (longer than MY_COLLECT_STAGGER_PERIOD with staggered slots) up to MY_COLLECT_ROUTE_REQUEST_MAX
+ * requests per command */
+#ifdef MY_COLLECT_CONF_ROUTE_DISCOVERY
+#define MY_COLLECT_ROUTE_DISCOVERY MY_COLLECT_CONF_ROUTE_DISCOVERY
+#else
+#define MY_COLLECT_ROUTE_DISCOVERY 0
+#endif
+
+#ifdef MY_COLLECT_CONF_ROUTE_REQUEST_SCOPE
+#define MY_COLLECT_ROUTE_REQUEST_SCOPE MY_COLLECT_CONF_ROUTE_REQUEST_SCOPE
+#else
+#define MY_COLLECT_ROUTE_REQUEST_SCOPE 10
+#endif
+
+#ifdef MY_COLLECT_CONF_ROUTE_REQUEST_TIMEOUT
+#define MY_COLLECT_ROUTE_REQUEST_TIMEOUT MY_COLLECT_CONF_ROUTE_REQUEST_TIMEOUT
+#else
+#define MY_COLLECT_ROUTE_REQUEST_TIMEOUT (CLOCK_SECOND * 4)
+#endif
+
+#ifdef MY_COLLECT_CONF_ROUTE_REQUEST_MAX
+#define MY_COLLECT_ROUTE_REQUEST_MAX MY_COLLECT_CONF_ROUTE_REQUEST_MAX
+#else
+#define MY_COLLECT_ROUTE_REQUEST_MAX 3
+#endif
+
+/* Max hops of an upward packet. Used to drop looping packets when paths are not
+ * piggybacked (loops cannot be detected analyzing the path) */
+#ifdef MY_COLLECT_CONF_MAX_HOPS
+#define MY_COLLECT_MAX_HOPS MY_COLLECT_CONF_MAX_HOPS
+#else
+#define MY_COLLECT_MAX_HOPS 32
+#endif
+
+
+/* Reasons of a packet drop (index of my_collect_stats.drops) */
+enum my_collect_drop_reason {
+  MY_COLLECT_DROP_NO_PARENT,
+  MY_COLLECT_DROP_NO_ROUTE,     // Sink: command destination not reachable with the routing table
+  MY_COLLECT_DROP_LOOP,
+  MY_COLLECT_DROP_MAX_HOPS,
+  MY_COLLECT_DROP_HDRALLOC,
+  MY_COLLECT_DROP_HDRREDUCE,
+  MY_COLLECT_DROP_MALFORMED,
+  MY_COLLECT_DROP_DUPLICATE,
+  MY_COLLECT_DROP_QUEUE_FULL,
+  MY_COLLECT_DROP_NOACK,        // Not acknowledged after all the retries
+  MY_COLLECT_DROP_REASON_COUNT
+};
+
+/* Statistics counters of a connection (16 bits, wrapping).
+ * Only uint16_t fields: snapshots are encoded iterating over the struct as an array */
+struct my_collect_stats {
+  uint16_t beacons_sent;
+  uint16_t beacons_received;
+  // Packets sent by the app (data packets and commands)
+  uint16_t data_originated;
+  // Packets of other nodes forwarded (upward packets and commands)
+  uint16_t data_forwarded;
+  // Packets delivered to the app (data packets on the sink, commands on nodes)
+  uint16_t data_delivered;
+  uint16_t parent_changes;
+  // Dedicated topology reports sent (queued: dropped ones are counted in drops) and suppressed
+  // (a child report already carried the topology)
+  uint16_t topology_reports_sent;
+  uint16_t topology_reports_suppressed;
+  uint16_t drops[MY_COLLECT_DROP_REASON_COUNT];
+};
+
+#define MY_COLLECT_STATS_COUNTERS ((int)(sizeof(struct my_collect_stats) / sizeof(uint16_t)))
+
+/* Queuing delay of the packets delivered to the app (ms) */
+struct my_collect_latency {
+  // Last packet delivered (valid in the recv/sr_recv callbacks): sum of the residence times in the
+  // queues of the nodes of its path (source or sink included), average, shortest and longest per node
+  uint16_t delay;
+  uint16_t hop_delay;
+  uint16_t hop_delay_min;
+  uint16_t hop_delay_max;
+  // Packets per delay (16 bits, wrapping): bucket 0 counts the delays of 0 ms, bucket i the delays
+  // in [2^(i-1), 2^i) ms, the last bucket also the longer ones
+  uint16_t histogram[MY_COLLECT_LATENCY_BUCKETS];
+};
+
+/* Packet recently received (duplicate cache entry) */
+struct recent_packet {
+  linkaddr_t source;
+  uint8_t seqn;
+};
+
+/* Packet waiting in the queue of a connection */
+struct queued_packet {
+  // Next hop ("linkaddr_null" for upward packets: they are sent to the current parent)
+  linkaddr_t next_hop;
+  uint8_t length;
+  uint8_t retries;
+  uint8_t failovers;
+  // Header + data of the packet
+  uint8_t data[PACKETBUF_SIZE];
+};
 
 /* Connection object */
 struct my_collect_conn {
   struct broadcast_conn bc;
   struct unicast_conn uc;
   const struct my_collect_callbacks *callbacks;
+  bool is_sink;
   linkaddr_t parent;
+  // Sink: periodic generation of a new beacon seqn, nodes: forwarding of the new seqn
   struct ctimer beacon_timer;
+  // Trickle timer used to schedule beacons (sink and routers)
+  struct ctimer trickle_timer;
+  clock_time_t trickle_interval;
+  clock_time_t trickle_t; // Beacon time in the current interval
+  uint8_t trickle_counter; // Consistent beacons heard in the current interval
   uint16_t metric;
   uint16_t beacon_seqn;
   int16_t parent_rssi;
+  // Cumulative ETX of the path to the sink (advertised in beacons, ETX_SCALE fixed point)
+  uint16_t path_etx;
+  // Incremented at every beacon sent (used by neighbors to estimate the beacon reception ratio)
+  uint8_t beacon_counter;
+  // Candidate parents (beacon senders) with their link estimation
+  struct neighbor_table neighbors;
+  // Queue of packets to send (static pool used as a ring buffer, the head is the packet in flight
+  // or waiting for the retry timer)
+  struct queued_packet queue[MY_COLLECT_QUEUE_SIZE];
+  uint8_t queue_head;
+  uint8_t queue_length;
+  struct ctimer queue_retry_timer;
+  // Incremented every time the parent changes (sent in parent reports)
+  uint8_t topology_epoch;
+  // Dedicated topology report sent after a parent change
+  struct ctimer topology_report_timer;
+#if MY_COLLECT_REPORT_CONTROL
+  // Token bucket of the reports (seconds per token and size, as advertised by the sink)
+  uint8_t report_period;
+  uint8_t report_burst;
+  uint8_t report_tokens;
+  clock_time_t report_refill_time;
+  // Doublings of the report delay (churn) and time of the last parent change
+  uint8_t report_backoff;
+  clock_time_t report_last_change;
+#endif
+  // Seqn of the next packet originated by the node (data packets and commands)
+  uint8_t packet_seqn;
+  // Packets recently received (ring buffer, a free entry has "linkaddr_null" as source)
+  struct recent_packet recent_packets[MY_COLLECT_DUPLICATE_CACHE_SIZE];
+  uint8_t recent_packets_next;
+  struct my_collect_stats stats;
+#if MY_COLLECT_LATENCY
+  struct my_collect_latency latency;
+#endif
+#if MY_COLLECT_STATS_REPORT
+  // Periodic snapshot of stats to the sink (pending until attached to an upward packet)
+  struct ctimer stats_timer;
+  bool stats_report_pending;
+#endif
+  // Sink only: <parent, child> pairs of the tree (used to source route commands), owned by the caller
+  struct routing_table *routing_table;
+#if ROUTING_TABLE_EXPORT
+  // Sink only: periodic snapshot of the routing table on the serial line
+  struct ctimer snapshot_timer;
+#endif
+#if MY_COLLECT_STAGGER
+  // Staggered slots: local time of the start of the current cycle (valid once synced with the parent)
+  struct ctimer stagger_timer;
+  clock_time_t stagger_cycle_start;
+  bool stagger_synced;
+  bool stagger_listening;
+  // The head of the queue waits for the slot of the node
+  bool stagger_held;
+  uint8_t stagger_idle_cycles;
+#endif
+#if MY_COLLECT_ROUTE_DISCOVERY
+  // Route requests (flooded from the sink)
+  struct broadcast_conn rreq_bc;
+  // Sink: next request for the pending command. Nodes: delayed rebroadcast of a request
+  struct ctimer rreq_timer;
+  // Seqn of the last request sent (sink) or heard (nodes, valid if rreq_heard) and time it was heard
+  uint8_t rreq_seqn;
+  bool rreq_heard;
+  clock_time_t rreq_time;
+  // Node that must reply to the last request (sink) or to the request to rebroadcast (nodes)
+  linkaddr_t rreq_target;
+  uint8_t rreq_hops_left;
+  // Sink: command waiting for the route to its destination ("linkaddr_null" if none)
+  linkaddr_t pending_dest;
+  uint8_t pending_requests;
+  uint8_t pending_length;
+  uint8_t pending_data[PACKETBUF_SIZE];
+#endif
+#if MY_COLLECT_BATCHING
+  // Forwarded packets waiting to be sent to the parent in a single frame
+  struct ctimer batch_timer;
+  uint8_t batch_length;
+  uint8_t batch[MY_COLLECT_BATCH_SIZE];
+#endif
 };
 
 
@@ -35,33 +476,117 @@ struct my_collect_callbacks {
    *   hops : number of route hops from the sink to the destination
    */
   void (*sr_recv)(struct my_collect_conn *c, uint8_t hops);
+
+  /* Statistics report recv function callback (optional, sink only):
+   * called when a snapshot of the counters of a node reaches the sink.
+   *
+   * Params:
+   *   source : the node that sent the snapshot
+   *   stats  : the counters of the node
+   */
+  void (*stats_recv)(const linkaddr_t *source, const struct my_collect_stats *stats);
 };
 
 
 struct collect_header { // Header structure for data packets
   linkaddr_t source;
   uint8_t hops;
+  // Per-source sequence number (used with "source" to detect duplicates)
+  uint8_t seqn;
 
   // True if the packet is a "command" packet sent from sink to another node (one-to-many) (it is a source routed packet).
   bool is_command;
   // Size of the array of node ids allocated after this header struct that represent the path
   // used by a packet to arrive to the sink or to a node.
   uint8_t path_length;
+  // Bitmask of COLLECT_FLAG_* values
+  uint8_t flags;
+#if MY_COLLECT_LATENCY
+  // Residence time in the queues of the nodes already crossed (clock ticks, wrapping), without the
+  // last one
+  uint16_t delay;
+  // Residence time in the queue of the last node (clock ticks). While the packet is in a queue the
+  // arrival time is subtracted from it, and added back at transmission
+  uint16_t hop_delay;
+  // Shortest and longest residence time in the queue of a single node (clock ticks, saturated at 255)
+  uint8_t hop_delay_min;
+  uint8_t hop_delay_max;
+#endif
+} __attribute__((packed));
+
+// Path array entries store only the low byte of the addresses (every high byte is zero)
+#define COLLECT_FLAG_COMPACT_PATH  0x01
+// Header is followed by a parent_report instead of the path array (path_length is 0)
+#define COLLECT_FLAG_PARENT_REPORT 0x02
+// Header is followed by a list of records <length (1 byte), packet (collect header + topology + payload)>
+// (path_length is 0). Each record is handled as a packet received from the sender of the batch
+#define COLLECT_FLAG_BATCH         0x04
+// Command with several destinations: header is followed by the routing tree of the receiver
+// (path_length bytes, see MULTICAST_TREE_*) instead of the route path
+#define COLLECT_FLAG_MULTICAST     0x08
+// Topology info is followed by a stats snapshot: the number of counters (1 byte) and the counters
+// of struct my_collect_stats in order, each one encoded with 7 bits per byte (MSB set if more bytes follow)
+#define COLLECT_FLAG_STATS         0x10
+
+/* Multicast routing tree: the receiver info byte followed by the <address, info byte> pairs of the
+ * nodes below it in preorder. An info byte has MULTICAST_TREE_DEST set if the node is a destination
+ * and the number of its children in the low bits */
+#define MULTICAST_TREE_DEST           0x80
+#define MULTICAST_TREE_CHILDREN_MASK  0x7F
+
+#if MY_COLLECT_MULTICAST_MAX_NODES > MULTICAST_TREE_CHILDREN_MASK
+#error "MY_COLLECT_MULTICAST_MAX_NODES must fit in MULTICAST_TREE_CHILDREN_MASK"
+#endif
+
+// Max length of an encoded routing tree (full addresses): the sink info byte and a pair per node
+#define MULTICAST_TREE_MAX_LENGTH (1 + MY_COLLECT_MULTICAST_MAX_NODES * (LINKADDR_SIZE + 1))
+// Max length of the tree carried by a copy: the subtree of a child of the sink (its info byte and a
+// pair per node below it)
+#define MULTICAST_TREE_MAX_CARRIED (MULTICAST_TREE_MAX_LENGTH - (LINKADDR_SIZE + 1))
+
+struct parent_report { // Topology info about the source of an upward packet
+  linkaddr_t parent;
+  // Source topology epoch: used by the sink to discard reports older than the known one
+  uint8_t epoch;
 } __attribute__((packed));
 
 
 /* Initialize a collect connection
  *  - conn -- a pointer to a connection object
- *  - channels -- starting channel C (the collect uses two: C and C+1)
+ *  - channels -- starting channel C (the collect uses two: C and C+1, and C+2 with MY_COLLECT_ROUTE_DISCOVERY)
  *  - is_sink -- initialize in either sink or router mode
- *  - callbacks -- a pointer to the callback structure */
+ *  - routing_table -- sink: storage of the routing table used to source route commands (required),
+ *    routers: NULL (only the sink pays for the table)
+ *  - callbacks -- a pointer to the callback structure
+ * With MY_COLLECT_STAGGER a node must open only one connection (see MY_COLLECT_STAGGER) */
 void my_collect_open(struct my_collect_conn *conn, uint16_t channels,
-                     bool is_sink,
+                     bool is_sink, struct routing_table *routing_table,
                      const struct my_collect_callbacks *callbacks);
 
 /* Send packet to the sink */
 int my_collect_send(struct my_collect_conn *c);
 
+/* Statistics counters of the connection */
+const struct my_collect_stats* my_collect_stats_get(const struct my_collect_conn *c);
+
+/* Total number of packets dropped by the connection (any reason) */
+uint32_t my_collect_stats_drops(const struct my_collect_conn *c);
+
+/* Reset the statistics counters of the connection (the latency data is kept) */
+void my_collect_stats_reset(struct my_collect_conn *c);
+
+#if MY_COLLECT_LATENCY
+/* Queuing delay of the last packet delivered and histogram of the delays */
+const struct my_collect_latency* my_collect_latency_get(const struct my_collect_conn *c);
+#endif
+
+#if MY_COLLECT_REPORT_CONTROL
+/* Sink: set the token bucket of the topology reports of the network (advertised in beacons)
+ *  - period -- seconds per token (0: no rate limit)
+ *  - burst -- size of the bucket (0: no dedicated reports, the topology is carried by data only) */
+void my_collect_report_control_set(struct my_collect_conn *c, uint8_t period, uint8_t burst);
+#endif
+
 
 /**
  * - Update current nose's parent,
@@ -78,16 +603,34 @@ void update_node_parent(struct my_collect_conn *conn, uint16_t beacon_metric, co
 void send_topology_report_cb(void* ptr);
 
 /* Source routing send function:
+ * with MY_COLLECT_ROUTE_DISCOVERY, a command to a destination without a route is buffered
+ * (one at a time) and sent once the route has been discovered.
  *
  * Params:
  *   c    : pointer to the collection connection structure
  *   dest : pointer to the destination address
  *
  * Returns:
- *   non - zero if the packet could be sent , zero otherwise.
+ *   non - zero if the packet could be sent (or has been buffered), zero otherwise.
  */
 int sr_send(struct my_collect_conn *c, const linkaddr_t *dest);
 
+/* Source routing send function with several destinations:
+ * the routes to the destinations are merged in a routing tree attached to the packet,
+ * so the packet is duplicated only by the nodes where the routes diverge.
+ *
+ * Params:
+ *   c     : pointer to the collection connection structure
+ *   dests : array of destination addresses
+ *   n     : number of destinations (at most MY_COLLECT_MULTICAST_MAX_NODES)
+ *
+ * Returns:
+ *   the number of distinct destinations the packet has been sent to (destinations without a route
+ *   are skipped, a destination listed more than once is served and counted once),
+ *   zero if the packet could not be sent or there are too many destinations.
+ */
+int sr_send_multi(struct my_collect_conn *c, const linkaddr_t *dests, int n);
+
 
 
 /**
@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include "core/net/linkaddr.h"
+#include "contiki.h"
+#include <stdio.h>
+#include "my_neighbor_table.h"
+#include "my_trace.h"
+
+
+/* Neighbor table functions -----------------------------------------------------------*/
+
+/**
+ * Exponentially weighted moving average: new samples weight 1/4.
+ */
+static inline uint16_t etx_ewma(uint16_t current, uint32_t sample) {
+  uint32_t value = (((uint32_t)current * 3) + sample) / 4;
+  return value > ETX_MAX ? ETX_MAX : value;
+}
+
+void neighbor_table_init(struct neighbor_table *table) {
+  int i = 0;
+  for (i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+    linkaddr_copy(&table->entries[i].addr, &linkaddr_null);
+  }
+}
+
+struct neighbor* neighbor_table_get(struct neighbor_table *table, const linkaddr_t *addr) {
+  int i = 0;
+
+  if (linkaddr_cmp(addr, &linkaddr_null)) {
+    return NULL; // Free entries are not neighbors (eg: parent of a node not connected yet)
+  }
+  for (i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+    if (linkaddr_cmp(&table->entries[i].addr, addr)) {
+      return &table->entries[i];
+    }
+  }
+  return NULL;
+}
+
+uint16_t neighbor_path_cost(const struct neighbor *neighbor) {
+  uint32_t cost = (uint32_t)neighbor->path_etx + neighbor->link_etx;
+  return cost > ETX_MAX ? ETX_MAX : cost;
+}
+
+/**
+ * Path cost of an entry when looking for one to replace: neighbors without recent info are the first to go.
+ */
+static uint16_t neighbor_replace_cost(const struct neighbor *neighbor, uint16_t seqn) {
+  return neighbor_seqn_is_recent(neighbor->seqn, seqn) ? neighbor_path_cost(neighbor) : ETX_MAX;
+}
+
+/**
+ * Return a free entry or the entry to replace (the one with the worst path cost, "keep" excluded)
+ * for a new neighbor advertising "path_etx" in the beacon round "seqn". Return NULL if the table is
+ * full of neighbors at least as good as the new one.
+ */
+static struct neighbor* neighbor_table_alloc(struct neighbor_table *table, const linkaddr_t *keep,
+  uint16_t seqn, uint16_t path_etx) {
+  struct neighbor *worst = NULL;
+  uint16_t worst_cost = 0;
+  int i = 0;
+
+  for (i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+    struct neighbor *entry = &table->entries[i];
+
+    if (linkaddr_cmp(&entry->addr, &linkaddr_null)) {
+      return entry;
+    }
+    if (keep != NULL && linkaddr_cmp(&entry->addr, keep)) {
+      continue;
+    }
+    uint16_t cost = neighbor_replace_cost(entry, seqn);
+    if (worst == NULL || cost > worst_cost) {
+      worst = entry;
+      worst_cost = cost;
+    }
+  }
+
+  // Link to the new neighbor is unknown: its cost is estimated with the initial link ETX
+  uint32_t new_cost = (uint32_t)path_etx + ETX_INIT;
+
+  if (worst == NULL || new_cost >= worst_cost) {
+    return NULL;
+  }
+
+  TRACE(TRACE_NEIGHBOR_REPLACED, worst->addr.u8[0], worst->addr.u8[1]);
+  return worst;
+}
+
+struct neighbor* neighbor_table_update_beacon(struct neighbor_table *table, const linkaddr_t *addr, int16_t rssi,
+  uint8_t counter, uint16_t seqn, uint16_t metric, uint16_t path_etx, const linkaddr_t *parent,
+  const linkaddr_t *keep) {
+
+  struct neighbor *neighbor = neighbor_table_get(table, addr);
+
+  if (neighbor == NULL) {
+    // New neighbor
+    neighbor = neighbor_table_alloc(table, keep, seqn, path_etx);
+    if (neighbor == NULL) {
+      return NULL;
+    }
+
+    linkaddr_copy(&neighbor->addr, addr);
+    neighbor->rssi = rssi;
+    neighbor->link_etx = ETX_INIT;
+    neighbor->beacons_received = 0;
+    neighbor->beacons_expected = 0;
+
+  } else {
+    neighbor->rssi = (neighbor->rssi * 3 + rssi) / 4;
+
+    // Beacons missed since the last one received from the neighbor
+    uint8_t gap = counter - neighbor->beacon_counter;
+    if (gap > 0 && gap < NEIGHBOR_BEACON_WINDOW * 4) { // Larger gaps: neighbor rebooted -> ignore them
+      neighbor->beacons_expected += gap - 1;
+    }
+  }
+
+  neighbor->beacon_counter = counter;
+  neighbor->beacons_received++;
+  neighbor->beacons_expected++;
+  neighbor->seqn = seqn;
+  neighbor->metric = metric;
+  neighbor->path_etx = path_etx;
+  linkaddr_copy(&neighbor->parent, parent);
+
+  if (neighbor->beacons_expected >= NEIGHBOR_BEACON_WINDOW) {
+    // New reception ratio sample: ETX = expected / received
+    uint32_t sample = ((uint32_t)ETX_SCALE * neighbor->beacons_expected) / neighbor->beacons_received;
+    neighbor->link_etx = etx_ewma(neighbor->link_etx, sample);
+    neighbor->beacons_received = 0;
+    neighbor->beacons_expected = 0;
+  }
+
+  return neighbor;
+}
+
+void neighbor_table_update_tx(struct neighbor_table *table, const linkaddr_t *addr, bool acked, int num_tx) {
+  struct neighbor *neighbor = neighbor_table_get(table, addr);
+
+  if (neighbor == NULL) {
+    return; // Only beacon senders are tracked
+  }
+
+  uint32_t sample = acked ? (uint32_t)ETX_SCALE * (num_tx > 0 ? num_tx : 1) : ETX_NOACK_PENALTY;
+  neighbor->link_etx = etx_ewma(neighbor->link_etx, sample);
+
+  TRACE(TRACE_NEIGHBOR_LINK_UPDATED,
+    addr->u8[0], addr->u8[1], acked, num_tx, neighbor->link_etx);
+}
+
+struct neighbor* neighbor_table_best(struct neighbor_table *table, uint16_t seqn) {
+  struct neighbor *best = NULL;
+  int i = 0;
+
+  for (i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+    struct neighbor *entry = &table->entries[i];
+
+    if (linkaddr_cmp(&entry->addr, &linkaddr_null) || !neighbor_seqn_is_recent(entry->seqn, seqn) ||
+        entry->path_etx == ETX_MAX || linkaddr_cmp(&entry->parent, &linkaddr_node_addr)) {
+      continue;
+    }
+    if (best == NULL || neighbor_path_cost(entry) < neighbor_path_cost(best)) {
+      best = entry;
+    }
+  }
+
+  return best;
+}
+
+struct neighbor* neighbor_table_best_candidate(struct neighbor_table *table, uint16_t seqn,
+  uint16_t metric, uint16_t path_etx, const linkaddr_t *exclude) {
+  struct neighbor *best = NULL;
+  int i = 0;
+
+  for (i = 0; i < NEIGHBOR_TABLE_SIZE; i++) {
+    struct neighbor *entry = &table->entries[i];
+
+    if (linkaddr_cmp(&entry->addr, &linkaddr_null) || entry->seqn != seqn || entry->path_etx == ETX_MAX ||
+        (exclude != NULL && linkaddr_cmp(&entry->addr, exclude))) {
+      continue;
+    }
+    // Strictly closer to the sink (a sibling with stale info could pick the node back)
+    if (entry->metric > metric || (entry->metric == metric && entry->path_etx >= path_etx)) {
+      continue;
+    }
+    // Child of the node (with a stale metric)
+    if (linkaddr_cmp(&entry->parent, &linkaddr_node_addr)) {
+      continue;
+    }
+    if (best == NULL || neighbor_path_cost(entry) < neighbor_path_cost(best)) {
+      best = entry;
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,138 @@
+#ifndef MY_NEIGHBOR_TABLE_H
+#define MY_NEIGHBOR_TABLE_H
+
+#include <stdbool.h>
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+
+
+/* Neighbor table config --------------------------------------------------------------*/
+
+/**
+ * Max number of neighbors known by a node (candidate parents).
+ */
+#ifdef NEIGHBOR_TABLE_CONF_SIZE
+#define NEIGHBOR_TABLE_SIZE NEIGHBOR_TABLE_CONF_SIZE
+#else
+#define NEIGHBOR_TABLE_SIZE 8
+#endif
+
+/**
+ * ETX values are fixed point numbers: ETX_SCALE means 1 transmission.
+ */
+#define ETX_SCALE 128
+// ETX of a link never used before
+#define ETX_INIT (2 * ETX_SCALE)
+// ETX sample of a unicast that has not been acknowledged
+#define ETX_NOACK_PENALTY (10 * ETX_SCALE)
+// Max (unknown/unreachable) ETX
+#define ETX_MAX 0xFFFF
+
+/**
+ * Number of beacons expected from a neighbor before computing a new reception ratio sample.
+ */
+#define NEIGHBOR_BEACON_WINDOW 8
+
+/**
+ * Info of a neighbor is recent if advertised in the current beacon round (seqn) or in the previous
+ * one: neighbors are not all refreshed at the same time when the sink starts a new round.
+ */
+static inline bool neighbor_seqn_is_recent(uint16_t neighbor_seqn, uint16_t seqn) {
+  return (uint16_t)(seqn - neighbor_seqn) <= 1;
+}
+
+
+/* Neighbor table structs -------------------------------------------------------------*/
+
+/**
+ * Link and path info about a neighbor. An entry with addr equal to "linkaddr_null" is free.
+ */
+struct neighbor {
+  linkaddr_t addr;
+  // EWMA of the beacons RSSI
+  int16_t rssi;
+  // Link ETX estimation (EWMA of beacon reception ratio and unicast transmissions)
+  uint16_t link_etx;
+  // Info advertised by the last beacon of the neighbor
+  uint16_t seqn;
+  uint16_t metric;
+  uint16_t path_etx;
+  linkaddr_t parent;
+  // Beacon reception ratio: counter of the last beacon, beacons received and expected in the window
+  uint8_t beacon_counter;
+  uint8_t beacons_received;
+  uint8_t beacons_expected;
+};
+
+struct neighbor_table {
+  struct neighbor entries[NEIGHBOR_TABLE_SIZE];
+};
+
+
+/* Neighbor table functions -----------------------------------------------------------*/
+
+/**
+ * Initialize the neighbor table (mark all the entries as free).
+ *
+ */
+void neighbor_table_init(struct neighbor_table *table);
+
+/**
+ * Return the entry of a neighbor or NULL if it is unknown.
+ *
+ */
+struct neighbor* neighbor_table_get(struct neighbor_table *table, const linkaddr_t *addr);
+
+/**
+ * Update the entry of a neighbor with the info of a beacon received from it.
+ * If the neighbor is new and the table is full, the neighbor with the worst path cost (except "keep",
+ * usually the current parent, and counting neighbors without recent info as unreachable) is replaced,
+ * only if the new neighbor would have a strictly lower path cost (ie: a stable table keeps its link
+ * estimations).
+ *
+ * Inputs:
+ *   counter: per-sender beacon counter (used to estimate the beacon reception ratio)
+ *
+ * Return the neighbor entry or NULL if it cannot be stored.
+ *
+ */
+struct neighbor* neighbor_table_update_beacon(struct neighbor_table *table, const linkaddr_t *addr, int16_t rssi,
+  uint8_t counter, uint16_t seqn, uint16_t metric, uint16_t path_etx, const linkaddr_t *parent,
+  const linkaddr_t *keep);
+
+/**
+ * Update the link ETX of a neighbor with the outcome of a unicast transmission to it.
+ *
+ * Inputs:
+ *   acked:  true if the packet has been acknowledged
+ *   num_tx: number of transmissions done by the MAC layer
+ *
+ */
+void neighbor_table_update_tx(struct neighbor_table *table, const linkaddr_t *addr, bool acked, int num_tx);
+
+/**
+ * Return the ETX of the path to the sink through a neighbor (path ETX advertised + link ETX).
+ *
+ */
+uint16_t neighbor_path_cost(const struct neighbor *neighbor);
+
+/**
+ * Return the neighbor with the lowest path cost among the ones with recent info about the beacon
+ * seqn (see neighbor_seqn_is_recent()), children excluded (or NULL if there are none).
+ *
+ */
+struct neighbor* neighbor_table_best(struct neighbor_table *table, uint16_t seqn);
+
+/**
+ * Return the neighbor with the lowest path cost among the ones that advertised the beacon seqn
+ * and are closer to the sink than the node ("metric" and "path_etx" are the ones of the node):
+ * a lower metric, or the same metric and a lower path ETX. Neighbors whose advertised parent is
+ * the node and "exclude" are skipped. Used to rank backup parents (or NULL if there are none):
+ * two siblings can never fail over to each other.
+ *
+ */
+struct neighbor* neighbor_table_best_candidate(struct neighbor_table *table, uint16_t seqn,
+  uint16_t metric, uint16_t path_etx, const linkaddr_t *exclude);
+
+
+#endif  // MY_NEIGHBOR_TABLE_H
@@ -2,200 +2,564 @@
 #include "core/net/linkaddr.h"
 #include "contiki.h"
 #include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
 #include "my_routing_table.h"
+#include "my_trace.h"
 
 
-/* Routing table vars -----------------------------------------------------------------*/
+/* Routing table functions ------------------------------------------------------------*/
 
-int routing_table_size = 255;
-struct routing_table_entry* *routing_table = NULL;
+/**
+ * Return the first slot to probe for a node address.
+ * (x ^ (x >> 8)) is a bijection over 16 bits, so both address bytes contribute to the slot.
+ */
+static inline unsigned routing_table_hash(const linkaddr_t *node) {
+  return (node->u16 ^ (node->u16 >> 8)) & (ROUTING_TABLE_SIZE - 1);
+}
 
+/**
+ * Return the slot containing the node (as child) or, if node is not present, the first free
+ * slot met while probing. Return -1 if the node is not present and the table is full.
+ */
+static int routing_table_lookup(struct routing_table *table, const linkaddr_t *node) {
+  unsigned index = routing_table_hash(node);
+  unsigned probes;
 
-/* Routing table functions ------------------------------------------------------------*/
+  for (probes = 0; probes < ROUTING_TABLE_SIZE; probes++) {
+    struct routing_table_entry *entry = &table->entries[index];
+
+    if (linkaddr_cmp(&entry->child, node) || linkaddr_cmp(&entry->child, &linkaddr_null)) {
+      return index;
+    }
+    index = (index + 1) & (ROUTING_TABLE_SIZE - 1);
+  }
+
+  return -1;
+}
+
+/**
+ * Current time for the last-heard times of the entries (seconds, 16 bits).
+ */
+static inline uint16_t routing_table_now(void) {
+  return (uint16_t)clock_seconds();
+}
+
+/**
+ * Return true if the pair of a used entry has not been heard for more than ROUTING_TABLE_TTL.
+ */
+static inline bool routing_table_is_stale(uint16_t heard, uint16_t now) {
+  return ROUTING_TABLE_TTL > 0 && (uint16_t)(now - heard) > ROUTING_TABLE_TTL;
+}
+
+/**
+ * Free the entry at index (backward shift deletion: the following entries of the cluster that
+ * would not be reachable anymore from their first slot are moved back, so no tombstone is needed).
+ */
+static void routing_table_remove(struct routing_table *table, unsigned index) {
+  unsigned hole = index;
+  unsigned next = index;
+
+  if (!PATH_ENTRY_IS_COMPACT(&table->entries[index].child)) {
+    table->wide_children_count--;
+  }
+  table->count--;
+  // Routes through the child computed before now are stale
+  table->generation++;
+#if ROUTING_TABLE_EXPORT
+  TRACE(TRACE_TOPO_REMOVED, table->entries[index].child.u8[0], table->entries[index].child.u8[1]);
+#endif
+
+  linkaddr_copy(&table->entries[hole].parent, &linkaddr_null);
+  linkaddr_copy(&table->entries[hole].child, &linkaddr_null);
+
+  for (;;) {
+    next = (next + 1) & (ROUTING_TABLE_SIZE - 1);
+    struct routing_table_entry *entry = &table->entries[next];
+
+    if (linkaddr_cmp(&entry->child, &linkaddr_null)) {
+      break; // End of the cluster
+    }
+
+    // Move the entry to the hole if its first slot is not between the hole and its slot
+    unsigned home = routing_table_hash(&entry->child);
+    if (((next - home) & (ROUTING_TABLE_SIZE - 1)) >= ((next - hole) & (ROUTING_TABLE_SIZE - 1))) {
+      table->entries[hole] = *entry;
+      linkaddr_copy(&entry->parent, &linkaddr_null);
+      linkaddr_copy(&entry->child, &linkaddr_null);
+      hole = next;
+    }
+  }
+}
 
-void routing_table_init() {
+/**
+ * Return the index of the used entry heard least recently (the table must not be empty).
+ */
+static unsigned routing_table_lru(struct routing_table *table, uint16_t now) {
+  unsigned lru = 0;
+  uint16_t lru_age = 0;
+  unsigned i;
 
-  routing_table =  (struct routing_table_entry**) malloc(routing_table_size);
+  for (i = 0; i < ROUTING_TABLE_SIZE; i++) {
+    struct routing_table_entry *entry = &table->entries[i];
 
-  // Check if success
-  if (routing_table == NULL) {
-    printf("<routing_table> Fail to allocate routing table\n");
-    exit(-1);
+    if (!linkaddr_cmp(&entry->child, &linkaddr_null) && (uint16_t)(now - entry->last_heard) >= lru_age) {
+      lru = i;
+      lru_age = now - entry->last_heard;
+    }
   }
 
-  // Init all entries to NULL
+  return lru;
+}
+
+void routing_table_init(struct routing_table *table) {
+  // Init all entries to free
   int i = 0;
-  for (i = 0; i < routing_table_size; i++) {
-    routing_table[i] = NULL;
+  for (i = 0; i < ROUTING_TABLE_SIZE; i++) {
+    linkaddr_copy(&table->entries[i].parent, &linkaddr_null);
+    linkaddr_copy(&table->entries[i].child, &linkaddr_null);
+  }
+  table->count = 0;
+  table->generation = 0;
+  table->time = routing_table_now();
+#if ROUTING_TABLE_EXPORT
+  table->snapshot_seqn = 0;
+#endif
+  table->wide_children_count = 0;
+
+#if ROUTE_CACHE_SIZE > 0
+  for (i = 0; i < ROUTE_CACHE_SIZE; i++) {
+    linkaddr_copy(&table->route_cache[i].dest, &linkaddr_null);
   }
+  table->route_cache_victim = 0;
+#endif
+}
 
+struct routing_table_entry* routing_table_get(struct routing_table *table) {
+  return table->entries;
 }
 
-struct routing_table_entry** routing_table_get() {
-  return routing_table;
+int routing_table_length(struct routing_table *table) {
+  return table->count;
 }
 
+uint16_t routing_table_generation(struct routing_table *table) {
+  return table->generation;
+}
+
+bool routing_table_is_compact(struct routing_table *table) {
+  // Parents are children too (except the sink, which is never part of a route)
+  return table->wide_children_count == 0;
+}
 
-linkaddr_t routing_table_get_parent(const linkaddr_t node) {
 
-  // Calc index in routing table
-  uint16_t index = node.u16;
-  struct routing_table_entry* entry = routing_table[index];
-  if (entry == NULL) {
+linkaddr_t routing_table_get_parent(struct routing_table *table, const linkaddr_t node) {
+
+  // Search the slot of the node
+  int index = routing_table_lookup(table, &node);
+  if (index < 0 || linkaddr_cmp(&table->entries[index].child, &linkaddr_null) ||
+      routing_table_is_stale(table->entries[index].last_heard, table->time)) {
     return linkaddr_null;
   } else {
-    return entry->parent;
+    return table->entries[index].parent;
+  }
+}
+
+int routing_table_age(struct routing_table *table, const linkaddr_t *node) {
+  int index = routing_table_lookup(table, node);
+
+  if (index < 0 || linkaddr_cmp(&table->entries[index].child, &linkaddr_null)) {
+    return -1;
+  }
+  return (uint16_t)(routing_table_now() - table->entries[index].last_heard);
+}
+
+int routing_table_expire(struct routing_table *table) {
+  uint16_t now = routing_table_now();
+  int expired = 0;
+  unsigned i = 0;
+
+  table->time = now;
+
+  if (ROUTING_TABLE_TTL == 0) {
+    return 0;
   }
+
+  while (i < ROUTING_TABLE_SIZE) {
+    struct routing_table_entry *entry = &table->entries[i];
+
+    if (!linkaddr_cmp(&entry->child, &linkaddr_null) && routing_table_is_stale(entry->last_heard, now)) {
+      TRACE(TRACE_RT_EXPIRED,
+        entry->child.u8[0], entry->child.u8[1], (uint16_t)(now - entry->last_heard));
+      routing_table_remove(table, i);
+      expired++;
+      continue; // Another entry may have been moved to this slot
+    }
+    i++;
+  }
+
+  return expired;
 }
 
 
-void routing_table_update_entry(const linkaddr_t *parent, const linkaddr_t *child) {
+int routing_table_update_entry(struct routing_table *table, const linkaddr_t *parent, const linkaddr_t *child) {
 
-  printf("<routing_table> Updating table with <parent: %02x:%02x, child: %02x:%02x>\n",
+#if !ROUTING_TABLE_EXPORT
+  // With the export the changes are already logged as topology records (refreshes are not)
+  TRACE(TRACE_RT_UPDATE,
     parent->u8[0], parent->u8[1], child->u8[0], child->u8[1]);
+#endif
+
+  if (linkaddr_cmp(child, &linkaddr_null)) { // "linkaddr_null" marks free entries -> it cannot be a child
+    TRACE(TRACE_RT_NULL_CHILD);
+    return 0;
+  }
+
+  uint16_t now = routing_table_now();
+
+  table->time = now;
+
+  // Search the slot of the child
+  int index = routing_table_lookup(table, child);
+
+  if (index < 0) { // Child is new but there are no free slots -> make room evicting the LRU entry
+    unsigned lru = routing_table_lru(table, now);
+
+    TRACE(TRACE_RT_EVICTED,
+      ROUTING_TABLE_SIZE, table->entries[lru].child.u8[0], table->entries[lru].child.u8[1],
+      (uint16_t)(now - table->entries[lru].last_heard));
+    routing_table_remove(table, lru);
+    index = routing_table_lookup(table, child);
+  }
 
-  // Calc index in routing table
-  uint16_t index = child->u16;
+  struct routing_table_entry* current_entry = &table->entries[index];
+
+  if (linkaddr_cmp(&current_entry->child, &linkaddr_null)) {
+    // Initialize the free entry (a new child is not part of any cached route)
+    linkaddr_copy(&current_entry->child, child);
+    current_entry->generation = table->generation;
+    current_entry->epoch = 0;
+    table->count++;
+    if (!PATH_ENTRY_IS_COMPACT(child)) {
+      table->wide_children_count++;
+    }
+#if ROUTING_TABLE_EXPORT
+    TRACE(TRACE_TOPO_ADDED, child->u8[0], child->u8[1], parent->u8[0], parent->u8[1]);
+#endif
+
+  } else if (!linkaddr_cmp(&current_entry->parent, parent)) {
+    // Parent changed -> routes through the child computed before now are stale
+    table->generation++;
+    current_entry->generation = table->generation;
+#if ROUTING_TABLE_EXPORT
+    TRACE(TRACE_TOPO_CHANGED, child->u8[0], child->u8[1], parent->u8[0], parent->u8[1]);
+#endif
+  }
+
+  // Set (or replace) the parent
+  linkaddr_copy(&current_entry->parent, parent);
+  current_entry->last_heard = now;
+  return 1;
+}
 
-  // Get current entry
-  struct routing_table_entry* current_entry = routing_table[index];
 
-  if (current_entry == NULL) {
-    // Initialize entry
+int routing_table_update_report(struct routing_table *table, const linkaddr_t *parent, const linkaddr_t *child, uint8_t epoch) {
+  int index = routing_table_lookup(table, child);
 
-    // Allocate new space for the entry
-    struct routing_table_entry* new_entry = (struct routing_table_entry*) malloc(sizeof(struct routing_table_entry));
+  if (index >= 0 && !linkaddr_cmp(&table->entries[index].child, &linkaddr_null)) {
+    int8_t age = (int8_t)(table->entries[index].epoch - epoch);
 
-    // Check if success
-    if (new_entry == NULL) {
-      printf("<routing_table> Fail to allocate space for a new entry\n");
-      exit(-1);
+    if (age > 0 && age <= ROUTING_TABLE_EPOCH_WINDOW) {
+      TRACE(TRACE_RT_OLD_REPORT,
+        child->u8[0], child->u8[1], epoch, table->entries[index].epoch);
+      return 0;
     }
+  }
+
+  if (!routing_table_update_entry(table, parent, child)) {
+    return 0;
+  }
 
-    // Set values
-    linkaddr_copy(&new_entry->parent, parent);
-    linkaddr_copy(&new_entry->child, child);
+  // Entry exists now (lookup again: it may have been just inserted)
+  table->entries[routing_table_lookup(table, child)].epoch = epoch;
+  return 1;
+}
 
-    // Set pointer
-    routing_table[index] = new_entry;
-    return; // Child inserted -> nothing more to do
 
-  } else { // Update the existing entry replacing the parent
-    linkaddr_copy(&current_entry->parent, parent);
+/**
+ * Return the entry of a child whose pair can be used in a route,
+ * NULL if the child is not known or its pair is stale.
+ */
+static struct routing_table_entry* routing_table_route_entry(struct routing_table *table, const linkaddr_t *node, uint16_t now) {
+  int index = routing_table_lookup(table, node);
+
+  if (index < 0 || linkaddr_cmp(&table->entries[index].child, &linkaddr_null)) {
+    return NULL;
+  }
+  if (routing_table_is_stale(table->entries[index].last_heard, now)) {
+    TRACE(TRACE_RT_ROUTE_STALE,
+      node->u8[0], node->u8[1], (uint16_t)(now - table->entries[index].last_heard));
+    return NULL;
   }
+  return &table->entries[index];
 }
 
 
-struct source_route routing_table_find_route_path(const linkaddr_t *dest) {
-  printf("<routing_table> <find_route> Search route for %02x:%02x\n", dest->u8[0], dest->u8[1]);
+/* Topology export --------------------------------------------------------------------*/
 
-  // Init route with dest node
-  linkaddr_t* route = (linkaddr_t*) malloc(sizeof(linkaddr_t));
-  int route_length = 1;
-  route[0] = *dest;
+#if ROUTING_TABLE_EXPORT
+/**
+ * Return the hops from the sink to a child, 0 if its chain of parents does not reach the sink.
+ */
+static int routing_table_depth(struct routing_table *table, const linkaddr_t *node) {
+  linkaddr_t current_node = *node;
+  int depth = 0;
 
-    if (route == NULL) {
-      printf("<routing_table> <find_route> Fail to allocate space for route\n");
-      exit(-1);
+  while (depth < ROUTING_TABLE_MAX_ROUTE_LENGTH) {
+    int index = routing_table_lookup(table, &current_node);
+
+    if (index < 0 || linkaddr_cmp(&table->entries[index].child, &linkaddr_null)) {
+      return 0; // Parent missing
+    }
+    depth++;
+    current_node = table->entries[index].parent;
+    if (linkaddr_cmp(&current_node, &linkaddr_node_addr)) {
+      return depth;
     }
+  }
 
-  // Current interaction destination node
-  linkaddr_t current_node = *dest;
+  return 0; // Loop
+}
 
-  // Search a path while route is not arrived to sink (current dest node is sink)
-  while(!linkaddr_cmp(&linkaddr_node_addr, &current_node)) {
-    // Get the parent node of the current dest
-    linkaddr_t parent_node = routing_table_get_parent(current_node);
+void routing_table_snapshot(struct routing_table *table) {
+  uint16_t now = routing_table_now();
+  int i;
+
+  table->snapshot_seqn++;
+  TRACE(TRACE_TOPO_SNAPSHOT_BEGIN, table->snapshot_seqn, table->count);
 
-    // Check of parent exists
-    if (linkaddr_cmp(&parent_node, &linkaddr_null)) {
-      printf("<routing_table> <find_route> Fail to create route. Parent of %02x:%02x is missing\n", current_node.u8[0], current_node.u8[1]);
-      return (struct source_route) {.route = NULL, .length = 0}; // Parent does not exists -> route is incomplete and cannot be created
+  for (i = 0; i < ROUTING_TABLE_SIZE; i++) {
+    struct routing_table_entry *entry = &table->entries[i];
+
+    if (!linkaddr_cmp(&entry->child, &linkaddr_null)) {
+      TRACE(TRACE_TOPO_ENTRY, entry->child.u8[0], entry->child.u8[1], entry->parent.u8[0], entry->parent.u8[1],
+        routing_table_depth(table, &entry->child), (uint16_t)(now - entry->last_heard));
     }
+  }
+
+  TRACE(TRACE_TOPO_SNAPSHOT_END, table->snapshot_seqn);
+}
+#endif
 
-    // Parent found -> add current node to route array and proceed to next iteration
-    printf("<routing_table> <find_route> Found parent of %02x:%02x. It is %02x:%02x\n",
-       current_node.u8[0], current_node.u8[1], parent_node.u8[0], parent_node.u8[1]);
-    route = route_add_node(route, route_length, parent_node);
 
-    if (route == NULL) {
-      printf("<routing_table> <find_route> Fail to reallocate space for route\n");
-      exit(-1);
+/* Route cache ------------------------------------------------------------------------*/
+
+#if ROUTE_CACHE_SIZE > 0
+/**
+ * Return the generation at which the parent of a node was last changed.
+ */
+static uint16_t routing_table_entry_generation(struct routing_table *table, const linkaddr_t *node) {
+  int index = routing_table_lookup(table, node);
+  if (index < 0 || linkaddr_cmp(&table->entries[index].child, &linkaddr_null)) {
+    return table->generation + 1; // Missing node -> newer than any cached route
+  }
+  return table->entries[index].generation;
+}
+
+/**
+ * Return the cached route for dest if it is still valid, NULL otherwise.
+ */
+static struct route_cache_entry* route_cache_lookup(struct routing_table *table, const linkaddr_t *dest) {
+  int i, j;
+
+  for (i = 0; i < ROUTE_CACHE_SIZE; i++) {
+    struct route_cache_entry *cached = &table->route_cache[i];
+
+    if (!linkaddr_cmp(&cached->dest, dest)) {
+      continue;
     }
 
-    // Update route length
-    route_length++;
+    if (routing_table_is_stale(cached->heard, table->time)) {
+      linkaddr_copy(&cached->dest, &linkaddr_null); // A pair may be stale -> recompute the route
+      return NULL;
+    }
 
-    if (check_loop_presence(route, route_length, parent_node) > 1) { // Loop found
-      printf("<routing_table> <find_route> Fail to create route. Loop has been detected\n");
-      return (struct source_route) {.route = NULL, .length = 0}; // Loop found in route -> route cannot be used
+    if (cached->generation == table->generation) {
+      return cached; // Nothing changed since the route was computed
     }
 
-    // Update next dest
-    current_node = parent_node;
+    // Something changed -> route is still valid if no node on it changed its parent after caching
+    for (j = 0; j < cached->length; j++) {
+      if ((int16_t)(routing_table_entry_generation(table, &cached->route[j]) - cached->generation) > 0) {
+        linkaddr_copy(&cached->dest, &linkaddr_null); // Stale -> free the cache entry
+        return NULL;
+      }
+    }
+    cached->generation = table->generation;
+    return cached;
+  }
+
+  return NULL;
+}
+
+/**
+ * Save a route (already validated) into the cache.
+ */
+static void route_cache_store(struct routing_table *table, const linkaddr_t *dest, const void *route, int length, uint8_t entry_size, uint16_t heard) {
+  struct route_cache_entry *cached = NULL;
+  int i;
 
+  if (length > ROUTE_CACHE_MAX_LENGTH) {
+    return; // Too long to be cached
   }
 
-  if (linkaddr_cmp(&linkaddr_node_addr, &current_node)) { // Arrived to sink
-    // Route (from child to sink) is complete -> reverse it and remove sink
+  // Use a free entry, otherwise replace one in round robin
+  for (i = 0; i < ROUTE_CACHE_SIZE && cached == NULL; i++) {
+    if (linkaddr_cmp(&table->route_cache[i].dest, &linkaddr_null) || linkaddr_cmp(&table->route_cache[i].dest, dest)) {
+      cached = &table->route_cache[i];
+    }
+  }
+  if (cached == NULL) {
+    cached = &table->route_cache[table->route_cache_victim];
+    table->route_cache_victim = (table->route_cache_victim + 1) % ROUTE_CACHE_SIZE;
+  }
 
-    // Alloc space for new array
-    int result_length = route_length - 1; // -1 exclude sink node from array (the last node inserted to route tail)
-    linkaddr_t* result = (linkaddr_t*) malloc(sizeof(linkaddr_t) * result_length);
+  linkaddr_copy(&cached->dest, dest);
+  cached->generation = table->generation;
+  cached->heard = heard;
+  cached->length = length;
+  for (i = 0; i < length; i++) {
+    path_entry_read(route, i, entry_size, &cached->route[i]);
+  }
+}
+#endif
+
+
+int routing_table_route_length(struct routing_table *table, const linkaddr_t *dest) {
+  TRACE(TRACE_RT_ROUTE_SEARCH, dest->u8[0], dest->u8[1]);
 
-    // Reverse the array
-    int i = result_length - 1;
-    for (i = result_length - 1; i >= 0; i--) {
-      result[(result_length - 1) - i] = route[i];
+#if ROUTE_CACHE_SIZE > 0
+  struct route_cache_entry *cached = route_cache_lookup(table, dest);
+  if (cached != NULL) {
+    return cached->length;
+  }
+#endif
+
+  // Current interaction destination node
+  linkaddr_t current_node = *dest;
+  int route_length = 0;
+  uint16_t now = table->time;
+
+  // Walk up the parents while route is not arrived to sink (current dest node is sink)
+  while(!linkaddr_cmp(&linkaddr_node_addr, &current_node)) {
+
+    if (route_length == ROUTING_TABLE_MAX_ROUTE_LENGTH) {
+      // A loop-free route cannot be longer than the bound -> parents are chained in a loop
+      TRACE(TRACE_RT_ROUTE_LOOP);
+      return -1;
     }
 
-    printf("<routing_table> <find_route> Complete route found\n");
+    // Get the parent node of the current dest
+    struct routing_table_entry *entry = routing_table_route_entry(table, &current_node, now);
 
-    return (struct source_route) {.route = result, .length = result_length};
+    // Check of parent exists (and the link to it has been heard recently)
+    if (entry == NULL) {
+      TRACE(TRACE_RT_ROUTE_MISSING_PARENT, current_node.u8[0], current_node.u8[1]);
+      return -1; // Parent does not exists -> route is incomplete and cannot be created
+    }
 
-  } else {
-    printf("<routing_table> <find_route> Route search complete but not start from sink\n");
-    return (struct source_route) {.route = NULL, .length = 0}; // Should not happen
+    // Parent found -> count current node and proceed to next iteration
+    route_length++;
+    current_node = entry->parent;
   }
 
+  return route_length;
 }
 
-int check_loop_presence(linkaddr_t *route, int length, linkaddr_t node) {
+
+int routing_table_find_route_path(struct routing_table *table, const linkaddr_t *dest, void *route, int length, uint8_t entry_size) {
+  linkaddr_t current_node = *dest;
+  uint16_t now = table->time;
+  uint16_t heard = now; // Oldest last-heard time of the pairs of the route
+  int i;
+
+#if ROUTE_CACHE_SIZE > 0
+  struct route_cache_entry *cached = route_cache_lookup(table, dest);
+  if (cached != NULL && cached->length == length) {
+    TRACE(TRACE_RT_ROUTE_CACHED, dest->u8[0], dest->u8[1], length);
+    for (i = 0; i < length; i++) {
+      path_entry_write(route, i, entry_size, &cached->route[i]);
+    }
+    return length;
+  }
+#endif
+
+  // Walk from dest to sink filling the route from its tail -> route is already "reversed"
+  for (i = length - 1; i >= 0; i--) {
+    if (linkaddr_cmp(&current_node, &linkaddr_null) || linkaddr_cmp(&current_node, &linkaddr_node_addr)) {
+      TRACE(TRACE_RT_ROUTE_SHORT, length);
+      return -1;
+    }
+    path_entry_write(route, i, entry_size, &current_node);
+
+    struct routing_table_entry *entry = routing_table_route_entry(table, &current_node, now);
+    if (entry == NULL) {
+      current_node = linkaddr_null;
+      continue; // Missing or stale parent -> the route is short
+    }
+    if ((uint16_t)(now - entry->last_heard) > (uint16_t)(now - heard)) {
+      heard = entry->last_heard;
+    }
+    current_node = entry->parent;
+  }
+
+  if (!linkaddr_cmp(&linkaddr_node_addr, &current_node)) {
+    TRACE(TRACE_RT_ROUTE_NOT_FROM_SINK);
+    return -1; // Should not happen (length computed with routing_table_route_length())
+  }
+
+  TRACE(TRACE_RT_ROUTE_FOUND, length);
+
+#if ROUTE_CACHE_SIZE > 0
+  route_cache_store(table, dest, route, length, entry_size, heard);
+#endif
+  return length;
+}
+
+int check_loop_presence(const void *route, int length, uint8_t entry_size, linkaddr_t node) {
   int i = 0;
   int count = 0;
+  linkaddr_t entry;
 
   for (i = 0; i < length; i++) {
-    if (linkaddr_cmp(&route[i], &node)) {
+    path_entry_read(route, i, entry_size, &entry);
+    if (linkaddr_cmp(&entry, &node)) {
       count++;
     }
   }
 
   return count;
-};
-
+}
 
-linkaddr_t* route_add_node(linkaddr_t* array, int length, linkaddr_t node) {
 
-  // Create new array
-  linkaddr_t* new_array = (linkaddr_t*) malloc(sizeof(linkaddr_t) * (length + 1));
+/* Path encoding functions ------------------------------------------------------------*/
 
-  // Check success
-  if (new_array == NULL) {
-    return NULL;
-  }
+void path_entry_read(const void *path, int index, uint8_t entry_size, linkaddr_t *addr) {
+  const uint8_t *entry = (const uint8_t *)path + (entry_size * index);
 
-  // Copy entries of old array into new one
-  int i = 0;
-  for (i = 0; i < length; i++) {
-    new_array[i] = array[i];
+  if (entry_size == PATH_ENTRY_SIZE_COMPACT) {
+    addr->u8[0] = entry[0];
+    addr->u8[1] = 0;
+  } else {
+    memcpy(addr, entry, sizeof(linkaddr_t));
   }
-  // Add new node on tail
-  linkaddr_copy(&new_array[length], &node);
+}
 
-  // Free space
-  free(array);
+void path_entry_write(void *path, int index, uint8_t entry_size, const linkaddr_t *addr) {
+  uint8_t *entry = (uint8_t *)path + (entry_size * index);
 
-  // Return new array
-  return new_array;
+  if (entry_size == PATH_ENTRY_SIZE_COMPACT) {
+    entry[0] = addr->u8[0];
+  } else {
+    memcpy(entry, addr, sizeof(linkaddr_t));
+  }
 }
@@ -6,21 +6,154 @@
 #include "core/net/linkaddr.h"
 
 
+/* Routing table config ---------------------------------------------------------------*/
+
+/**
+ * Number of entries of the routing table (ie: max number of children known by the sink).
+ * Entries are stored in a static pool and addressed with open addressing (linear probing),
+ * so the value must be a power of two.
+ */
+#ifdef ROUTING_TABLE_CONF_SIZE
+#define ROUTING_TABLE_SIZE ROUTING_TABLE_CONF_SIZE
+#else
+#define ROUTING_TABLE_SIZE 64
+#endif
+
+#if (ROUTING_TABLE_SIZE & (ROUTING_TABLE_SIZE - 1)) != 0
+#error "ROUTING_TABLE_SIZE must be a power of two"
+#endif
+
+/**
+ * Max number of nodes in a source route (sink excluded).
+ * A longer chain of parents is considered a loop.
+ */
+#ifdef ROUTING_TABLE_CONF_MAX_ROUTE_LENGTH
+#define ROUTING_TABLE_MAX_ROUTE_LENGTH ROUTING_TABLE_CONF_MAX_ROUTE_LENGTH
+#else
+#define ROUTING_TABLE_MAX_ROUTE_LENGTH 32
+#endif
+
+/**
+ * Seconds after which a <parent, child> pair not carried by any packet is stale (0 disables aging):
+ * a stale pair is never used to build a route and its entry is freed (see routing_table_expire()).
+ * Last-heard times are kept in 16 bits, so the value must be lower than 32768.
+ */
+#ifdef ROUTING_TABLE_CONF_TTL
+#define ROUTING_TABLE_TTL ROUTING_TABLE_CONF_TTL
+#else
+#define ROUTING_TABLE_TTL 600
+#endif
+
+#if ROUTING_TABLE_TTL >= 32768
+#error "ROUTING_TABLE_TTL must be lower than 32768 seconds"
+#endif
+
+/**
+ * Topology export for monitoring: the table traces a change record for every child added, moved to
+ * a new parent or removed, and routing_table_snapshot() traces a full snapshot (the sink does it every
+ * ROUTING_TABLE_SNAPSHOT_PERIOD), so the tree can be rebuilt from the serial line (see topology.py).
+ * Records are INFO trace events: in binary trace mode they take a fixed-size record each.
+ */
+#ifdef ROUTING_TABLE_CONF_EXPORT
+#define ROUTING_TABLE_EXPORT ROUTING_TABLE_CONF_EXPORT
+#else
+#define ROUTING_TABLE_EXPORT 0
+#endif
+
+#ifdef ROUTING_TABLE_CONF_SNAPSHOT_PERIOD
+#define ROUTING_TABLE_SNAPSHOT_PERIOD ROUTING_TABLE_CONF_SNAPSHOT_PERIOD
+#else
+#define ROUTING_TABLE_SNAPSHOT_PERIOD (CLOCK_SECOND * 300)
+#endif
+
+/**
+ * A report with an epoch at most this much older than the known one is considered stale.
+ */
+#define ROUTING_TABLE_EPOCH_WINDOW 16
+
+/**
+ * Number of source routes cached by the sink (0 disables the cache) and
+ * max length of a cached route (longer routes are always recomputed).
+ */
+#ifdef ROUTE_CACHE_CONF_SIZE
+#define ROUTE_CACHE_SIZE ROUTE_CACHE_CONF_SIZE
+#else
+#define ROUTE_CACHE_SIZE 8
+#endif
+
+#ifdef ROUTE_CACHE_CONF_MAX_LENGTH
+#define ROUTE_CACHE_MAX_LENGTH ROUTE_CACHE_CONF_MAX_LENGTH
+#else
+#define ROUTE_CACHE_MAX_LENGTH 10
+#endif
+
+
+/**
+ * Size of an address in a compact path: only the low byte (u8[0]) is stored,
+ * so compact encoding can be used only if the high byte of every address is zero.
+ */
+#define PATH_ENTRY_SIZE_COMPACT 1
+#define PATH_ENTRY_SIZE_FULL    sizeof(linkaddr_t)
+
+#define PATH_ENTRY_IS_COMPACT(addr) ((addr)->u8[1] == 0)
+
+
 /* Routing table structs --------------------------------------------------------------*/
 
 
+/**
+ * <parent, child> pair. An entry with child equal to "linkaddr_null" is free.
+ * When the table is full, the entry heard least recently is evicted to make room for a new child.
+ */
 struct routing_table_entry {
   linkaddr_t parent;
   linkaddr_t child;
+  // Time (clock_seconds(), 16 bits) of the last packet carrying the pair
+  uint16_t last_heard;
+  // Value of the routing table generation counter when the parent was last changed
+  uint16_t generation;
+  // Last topology epoch reported by the child (see routing_table_update_report())
+  uint8_t epoch;
+};
+
+/**
+ * Source route computed for a destination, valid as long as no node on it changes its parent.
+ */
+struct route_cache_entry {
+  linkaddr_t dest; // "linkaddr_null" if the cache entry is free
+  // Routing table generation at which the route was known to be valid
+  uint16_t generation;
+  // Oldest last-heard time of the pairs of the route (the route is stale with it)
+  uint16_t heard;
+  uint8_t length;
+  linkaddr_t route[ROUTE_CACHE_MAX_LENGTH];
 };
 
 /**
- * Route from sink (not contained into route) to a destination node.
- * NB: the route is allocated dinamically -> call free() once it is no more useful.
+ * Routing table of a sink (one per collection connection).
  */
-struct source_route {
-  linkaddr_t* route;
-  int length;
+struct routing_table {
+  // Static pool of entries (no heap allocation): an entry is addressed by hashing the child address
+  struct routing_table_entry entries[ROUTING_TABLE_SIZE];
+  // Number of used entries
+  int count;
+  // Generation counter: incremented when the parent of a known child changes (or the child is removed)
+  uint16_t generation;
+  // Number of children whose address cannot be written in a compact path
+  int wide_children_count;
+  // Time of the last update or expiration: pairs are aged against it when building routes (so that
+  // no clock is read on lookups), routing_table_expire() must be called periodically to advance it
+  uint16_t time;
+#if ROUTING_TABLE_EXPORT
+  // Seqn of the last snapshot traced
+  uint16_t snapshot_seqn;
+#endif
+#if ROUTE_CACHE_SIZE > 0
+  // Cache of source routes computed by the sink
+  struct route_cache_entry route_cache[ROUTE_CACHE_SIZE];
+  // Next cache entry to replace when the cache is full (round robin)
+  uint8_t route_cache_victim;
+#endif
 };
 
 
@@ -28,60 +161,150 @@ struct source_route {
 
 
 /**
- * Initialize the routing table.
+ * Initialize the routing table (mark all the entries of the pool as free).
  *
  */
-void routing_table_init();
+void routing_table_init(struct routing_table *table);
 
 /**
  * Get routing table.
+ * Return the pool of ROUTING_TABLE_SIZE entries (free entries have child equal to "linkaddr_null").
  *
  */
-struct routing_table_entry** routing_table_get();
+struct routing_table_entry* routing_table_get(struct routing_table *table);
+
+/**
+ * Return the number of entries currently used in the routing table.
+ *
+ */
+int routing_table_length(struct routing_table *table);
+
+/**
+ * Return the generation counter of the routing table.
+ * It is incremented every time the parent of a known child changes.
+ *
+ */
+uint16_t routing_table_generation(struct routing_table *table);
 
 
 /**
  * Update an entry of the routing table replacing
- * the parent of a child node in the <parent, child> pair.
+ * the parent of a child node in the <parent, child> pair, and set its last-heard time to now.
+ * If the child is new and the table is full, the entry heard least recently is evicted.
+ *
+ * Return 1 if the entry has been inserted/updated, 0 if the child is "linkaddr_null".
+ *
+ */
+int routing_table_update_entry(struct routing_table *table, const linkaddr_t *parent, const linkaddr_t *child);
+
+/**
+ * Update an entry of the routing table with a <parent, child> pair reported by the child itself
+ * together with its topology epoch (incremented by the child at every parent change).
+ * Reports older than the last one received are discarded (eg: overtaken by a newer report).
+ * An epoch far behind the known one is accepted, since the child has probably rebooted.
+ *
+ * Return 1 if the entry has been inserted/updated, 0 otherwise.
  *
  */
-void routing_table_update_entry(const linkaddr_t *parent, const linkaddr_t *child);
+int routing_table_update_report(struct routing_table *table, const linkaddr_t *parent, const linkaddr_t *child, uint8_t epoch);
 
 /**
  * Return the rounting table parent entry for a child.
  * Input node is the child with respect to the <parent, child> entries saved in the routing table.
- * Return "linkaddr_null" if node does not exist.
+ * Return "linkaddr_null" if node does not exist or its pair is stale.
+ *
+ */
+linkaddr_t routing_table_get_parent(struct routing_table *table, const linkaddr_t node);
+
+/**
+ * Return the seconds since the pair of a child was last heard, -1 if the child is not known.
+ *
+ */
+int routing_table_age(struct routing_table *table, const linkaddr_t *node);
+
+/**
+ * Free the entries of the stale pairs (the ones not heard for ROUTING_TABLE_TTL seconds).
+ * Pairs are aged against the time of the last update or expiration: calling this periodically
+ * keeps the aging going when no packet reaches the sink, and the table (and its probe sequences) short.
+ *
+ * Return the number of entries freed.
  *
  */
-linkaddr_t routing_table_get_parent(const linkaddr_t node);
+int routing_table_expire(struct routing_table *table);
+
+#if ROUTING_TABLE_EXPORT
+/**
+ * Trace a full snapshot of the table: a record per entry with child, parent, depth (hops from the
+ * sink, 0 if the chain of parents does not reach it) and seconds since the pair was last heard,
+ * between a begin and an end record with the seqn of the snapshot.
+ *
+ */
+void routing_table_snapshot(struct routing_table *table);
+#endif
+
+/**
+ * Return the length of the route from sink (not contained into route) to a destination node
+ * (contained into route), ie: the number of nodes that the route array must store.
+ *
+ * Return -1 if route not exists (a parent is missing or the pair of a node of the route is stale)
+ * or loop is detected (the chain of parents is longer than ROUTING_TABLE_MAX_ROUTE_LENGTH).
+ *
+ * A valid cached route is used if present, so that no walk over the parents is needed.
+ */
+int routing_table_route_length(struct routing_table *table, const linkaddr_t *dest);
+
+/**
+ * Return true if all the nodes known by the routing table have an address that can
+ * be written in a compact path (see PATH_ENTRY_IS_COMPACT).
+ *
+ */
+bool routing_table_is_compact(struct routing_table *table);
 
 /**
  * Find a routing path to send a "command" packet (from sink to a destination node).
  *
- * Return struct with NULL route if route not exists (cannot be created) or loop is detected.
+ * The route is written directly into the caller-provided "route" buffer (no allocation):
+ * route[0] is the node reached first by the sink and route[length - 1] is the destination.
+ * Addresses are copied byte by byte, so the buffer may be unaligned (eg: the packetbuf header area).
+ * The route is taken from the cache if still valid, otherwise it is computed and cached.
+ *
+ * Inputs:
+ *   dest:       the destination node
+ *   route:      buffer with room for "length" entries of "entry_size" bytes
+ *   length:     route length, as returned by routing_table_route_length()
+ *   entry_size: PATH_ENTRY_SIZE_FULL or PATH_ENTRY_SIZE_COMPACT
+ *
+ * Return the route length or -1 if route not exists (cannot be created) or loop is detected.
  */
-struct source_route routing_table_find_route_path(const linkaddr_t *dest);
+int routing_table_find_route_path(struct routing_table *table, const linkaddr_t *dest, void *route, int length, uint8_t entry_size);
 
 /**
- * Check provided new_node is present more than once in the route array.
+ * Check provided node is present in the route array.
  * In this case, a loop is detected in route.
  *
  * Inputs:
- *   route:    the route array to check
- *   length:   length of route array to check
- *   new_node: the last node inserted into route
+ *   route:      the route array to check (may be unaligned)
+ *   length:     length of route array to check
+ *   entry_size: size of an entry of the route array
+ *   node:       the node to search
  *
  * Return how many times the node passed as input is present in the given route.
  *
  */
-int check_loop_presence(linkaddr_t *route, int length, linkaddr_t node);
+int check_loop_presence(const void *route, int length, uint8_t entry_size, linkaddr_t node);
+
 
+/* Path encoding functions ------------------------------------------------------------*/
 
+/**
+ * Read the index-th address of a path (or route) array encoded with "entry_size" bytes per entry.
+ */
+void path_entry_read(const void *path, int index, uint8_t entry_size, linkaddr_t *addr);
 
 /**
- * Add a node to a node arrays and return the new node.
+ * Write the index-th address of a path (or route) array encoded with "entry_size" bytes per entry.
  */
-linkaddr_t* route_add_node(linkaddr_t* array, int length, linkaddr_t node);
+void path_entry_write(void *path, int index, uint8_t entry_size, const linkaddr_t *addr);
 
 
 #endif  // MY_ROUTING_TABLE_H
@@ -0,0 +1,90 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "contiki.h"
+#include "sys/ctimer.h"
+#include "my_trace.h"
+
+
+/* Trace vars -------------------------------------------------------------------------*/
+
+#if !MY_TRACE_BINARY
+// Format strings of the disabled events are not stored
+const char *const my_trace_formats[MY_TRACE_EVENT_COUNT] = {
+#define MY_TRACE_EVENT(name, level, format) \
+  (MY_TRACE_LEVEL_##level <= MY_TRACE_LEVEL) ? format : NULL,
+#include "my_trace_events.h"
+#undef MY_TRACE_EVENT
+};
+#endif
+
+#if MY_TRACE_BINARY
+// Records not flushed yet (in order of time)
+static struct my_trace_record records[MY_TRACE_BUFFER_SIZE];
+static uint8_t records_count = 0;
+static struct ctimer flush_timer;
+static bool flush_timer_started = false;
+#endif
+
+
+/* Trace functions --------------------------------------------------------------------*/
+
+#if MY_TRACE_BINARY
+static void flush_timer_cb(void *ptr) {
+  my_trace_flush();
+  ctimer_reset(&flush_timer);
+}
+#endif
+
+void my_trace_init() {
+#if MY_TRACE_BINARY
+  if (!flush_timer_started) {
+    flush_timer_started = true;
+    ctimer_set(&flush_timer, MY_TRACE_FLUSH_INTERVAL, flush_timer_cb, NULL);
+  }
+#endif
+}
+
+void my_trace_record(uint8_t event, uint8_t nargs, ...) {
+#if MY_TRACE_BINARY
+  va_list args;
+  int i;
+
+  if (records_count == MY_TRACE_BUFFER_SIZE) {
+    my_trace_flush();
+  }
+
+  struct my_trace_record *record = &records[records_count++];
+  record->event = event;
+  record->nargs = nargs;
+  record->timestamp = clock_time();
+
+  va_start(args, nargs);
+  for (i = 0; i < nargs; i++) {
+    record->args[i] = va_arg(args, int);
+  }
+  va_end(args);
+#endif
+}
+
+void my_trace_flush() {
+#if MY_TRACE_BINARY
+  int i, j;
+
+  if (records_count == 0) {
+    return;
+  }
+
+  // One line per flush: a token per record <event (2 hex digits), timestamp (4), args (4 each)>
+  printf(MY_TRACE_LINE_PREFIX);
+  for (i = 0; i < records_count; i++) {
+    printf(" %02x%04x", records[i].event, records[i].timestamp);
+    for (j = 0; j < records[i].nargs; j++) {
+      printf("%04x", records[i].args[j]);
+    }
+  }
+  printf("\n");
+
+  records_count = 0;
+#endif
+}
@@ -0,0 +1,150 @@
+#ifndef MY_TRACE_H
+#define MY_TRACE_H
+
+#include <stdio.h>
+#include "contiki.h"
+
+
+/* Trace config -----------------------------------------------------------------------*/
+
+/**
+ * Log levels: an event is traced only if its level (see my_trace_events.h) is not greater
+ * than MY_TRACE_LEVEL. The check is a compile-time constant, so disabled events are removed
+ * by the compiler together with their format strings and arguments.
+ */
+#define MY_TRACE_LEVEL_NONE  0
+#define MY_TRACE_LEVEL_ERROR 1
+#define MY_TRACE_LEVEL_INFO  2
+#define MY_TRACE_LEVEL_DEBUG 3
+
+#ifdef MY_TRACE_CONF_LEVEL
+#define MY_TRACE_LEVEL MY_TRACE_CONF_LEVEL
+#else
+#define MY_TRACE_LEVEL MY_TRACE_LEVEL_DEBUG
+#endif
+
+/**
+ * Binary mode: instead of printing formatted strings, events are stored as fixed-size records
+ * in a RAM buffer of MY_TRACE_BUFFER_SIZE records, flushed over serial in bulk (as hex lines
+ * starting with MY_TRACE_LINE_PREFIX) when it is full or every MY_TRACE_FLUSH_INTERVAL.
+ * Use decode-trace.py to turn the records back into text.
+ */
+#ifdef MY_TRACE_CONF_BINARY
+#define MY_TRACE_BINARY MY_TRACE_CONF_BINARY
+#else
+#define MY_TRACE_BINARY 0
+#endif
+
+#ifdef MY_TRACE_CONF_BUFFER_SIZE
+#define MY_TRACE_BUFFER_SIZE MY_TRACE_CONF_BUFFER_SIZE
+#else
+#define MY_TRACE_BUFFER_SIZE 16
+#endif
+
+#ifdef MY_TRACE_CONF_FLUSH_INTERVAL
+#define MY_TRACE_FLUSH_INTERVAL MY_TRACE_CONF_FLUSH_INTERVAL
+#else
+#define MY_TRACE_FLUSH_INTERVAL (CLOCK_SECOND * 10)
+#endif
+
+#define MY_TRACE_LINE_PREFIX "#T"
+
+// Max number of arguments of an event
+#define MY_TRACE_MAX_ARGS 6
+
+
+/* Trace events -----------------------------------------------------------------------*/
+
+enum my_trace_event {
+#define MY_TRACE_EVENT(name, level, format) name,
+#include "my_trace_events.h"
+#undef MY_TRACE_EVENT
+  MY_TRACE_EVENT_COUNT
+};
+
+// Level of every event (MY_TRACE_LEVEL_OF_<name>)
+enum my_trace_event_level {
+#define MY_TRACE_EVENT(name, level, format) MY_TRACE_LEVEL_OF_##name = MY_TRACE_LEVEL_##level,
+#include "my_trace_events.h"
+#undef MY_TRACE_EVENT
+};
+
+#define MY_TRACE_ENABLED(event) (MY_TRACE_LEVEL_OF_##event <= MY_TRACE_LEVEL)
+
+// Format of every event as a constant array (my_trace_format_of_<name>): only used by the
+// compiler to check the arguments of TRACE() against the format, never stored in the binary
+#define MY_TRACE_EVENT(name, level, format) \
+  static const char my_trace_format_of_##name[] __attribute__((unused)) = format;
+#include "my_trace_events.h"
+#undef MY_TRACE_EVENT
+
+/**
+ * Binary record of an event. Arguments are truncated to 16 bits.
+ */
+struct my_trace_record {
+  uint8_t event;
+  uint8_t nargs;
+  uint16_t timestamp; // clock_time() when the event was traced
+  uint16_t args[MY_TRACE_MAX_ARGS];
+};
+
+// Number of arguments of a TRACE() call (0 to MY_TRACE_MAX_ARGS)
+#define MY_TRACE_NARGS(...) MY_TRACE_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define MY_TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+
+
+/* Trace functions --------------------------------------------------------------------*/
+
+/**
+ * Trace an event with its integer arguments, eg: TRACE(TRACE_PACKET_SENT, addr.u8[0], addr.u8[1]).
+ * Arguments are not evaluated if the event level is disabled. The format is looked up in a table,
+ * so the arguments are checked at compile time (-Wformat) by a dead printf of the constant format
+ * of the event, in both modes and whatever the level.
+ */
+#define MY_TRACE_CHECK(event, ...) do { \
+    if (0) { \
+      printf(my_trace_format_of_##event, ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#if MY_TRACE_BINARY
+#define TRACE(event, ...) do { \
+    MY_TRACE_CHECK(event, ##__VA_ARGS__); \
+    if (MY_TRACE_ENABLED(event)) { \
+      my_trace_record(event, MY_TRACE_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+    } \
+  } while (0)
+#else
+#define TRACE(event, ...) do { \
+    MY_TRACE_CHECK(event, ##__VA_ARGS__); \
+    if (MY_TRACE_ENABLED(event)) { \
+      printf(my_trace_formats[event], ##__VA_ARGS__); \
+    } \
+  } while (0)
+#endif
+
+/**
+ * Format strings of the events (text mode only, NULL for disabled events).
+ */
+extern const char *const my_trace_formats[MY_TRACE_EVENT_COUNT];
+
+/**
+ * Start the periodic flush of the binary records (does nothing in text mode or if already started).
+ *
+ */
+void my_trace_init();
+
+/**
+ * Store the record of an event in the buffer (the buffer is flushed first if it is full).
+ *
+ */
+void my_trace_record(uint8_t event, uint8_t nargs, ...);
+
+/**
+ * Print the records stored in the buffer and empty it.
+ *
+ */
+void my_trace_flush();
+
+
+#endif  // MY_TRACE_H
@@ -0,0 +1,126 @@
+/**
+ * Catalog of the trace events (X-macro list, included by my_trace.h and my_trace.c).
+ *
+ *   MY_TRACE_EVENT(name, level, format)
+ *
+ * The id of an event is its position in the list: append new events at the end of their section
+ * and keep decode-trace.py in sync (it parses this file) when events are reordered.
+ * A format takes at most MY_TRACE_MAX_ARGS integer arguments of 16 bits.
+ */
+
+/* Collect layer (my_collect.c) ---------------------------------------------------*/
+MY_TRACE_EVENT(TRACE_OPEN_NODE, INFO, "<open> Node is %u.\n")
+MY_TRACE_EVENT(TRACE_BEACON_SENT, DEBUG, "<out> <beacon> Beacon sent in broadcast (seqn: %d, metric: %d, path etx: %u)\n")
+MY_TRACE_EVENT(TRACE_BEACON_SUPPRESSED, DEBUG, "<out> <beacon> Beacon suppressed (consistent beacons heard: %u)\n")
+MY_TRACE_EVENT(TRACE_BEACON_FORWARD_SCHEDULED, DEBUG, "<in_> <beacon> New round %u, beacon forwarding scheduled\n")
+MY_TRACE_EVENT(TRACE_TRICKLE_INTERVAL, DEBUG, "<out> <beacon> Trickle interval: %u s\n")
+MY_TRACE_EVENT(TRACE_BEACON_WRONG_SIZE, ERROR, "<in_> <beacon> Beacon received but with the wrong size\n")
+MY_TRACE_EVENT(TRACE_BEACON_RECEIVED, DEBUG, "<in_> <beacon> Beacon received from: %02x:%02x (seqn: %u, metric: %u, path etx: %u, rssi %d)\n")
+MY_TRACE_EVENT(TRACE_BEACON_OLD, DEBUG, "<in_> <beacon> Received an old beacon (current node seqn %u, beacon seqn: %u). Discarded.\n")
+MY_TRACE_EVENT(TRACE_PARENT_UPDATED, DEBUG, "<in_> <beacon> Parent %02x:%02x updated (current metric: %u, path etx: %u, parent rssi: %d)\n")
+MY_TRACE_EVENT(TRACE_PARENT_NEW, INFO, "<in_> <beacon> Node has a new parent %02x:%02x (current metric: %u, path etx: %u, parent rssi: %d)\n")
+MY_TRACE_EVENT(TRACE_TOPOLOGY_REPORT_SCHEDULED, DEBUG, "<in_> <beacon> Schedule sending of dedicated topology report in %u seconds\n")
+MY_TRACE_EVENT(TRACE_TOPOLOGY_REPORT_SENT, INFO, "<out> <toprep> Sent dedicated topology report result: %d\n")
+MY_TRACE_EVENT(TRACE_SEND_NO_PARENT, ERROR, "<out> <packet> <ERROR> Trying to send a data collection packet but node's parent is missing!\n")
+MY_TRACE_EVENT(TRACE_SEND_HDRALLOC_FAILED, ERROR, "<out> <packet> <ERROR> Trying to send a data collection packet but node fails allocating header buffer!\n")
+MY_TRACE_EVENT(TRACE_PACKET_SENT, INFO, "<out> <packet> Sending data collection packet to %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_RECV_TOO_SHORT, ERROR, "<in_> <packet> <ERROR> Received a too short unicast packet! (length: %d)\n")
+MY_TRACE_EVENT(TRACE_RECV_DUPLICATE, INFO, "<in_> <packet> Duplicate packet dropped (from: %02x:%02x, source: %02x:%02x, seqn: %u)\n")
+MY_TRACE_EVENT(TRACE_QUEUE_NO_PARENT, ERROR, "<out> <queue> <ERROR> Node's parent is missing! Queued packet dropped\n")
+MY_TRACE_EVENT(TRACE_QUEUE_FULL, ERROR, "<out> <queue> <ERROR> Queue is full (%u packets). Packet dropped\n")
+MY_TRACE_EVENT(TRACE_QUEUE_BAD_LENGTH, ERROR, "<out> <queue> <ERROR> Packet of %u bytes is empty or does not fit the queue. Packet dropped\n")
+MY_TRACE_EVENT(TRACE_PARENT_FAILOVER, INFO, "<out> <packet> Parent %02x:%02x did not ack the packet. Failover to %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_QUEUE_RETRIES_EXCEEDED, ERROR, "<out> <queue> <ERROR> Packet not acknowledged after %u retries. Packet dropped\n")
+MY_TRACE_EVENT(TRACE_QUEUE_SEND_FAILED, ERROR, "<out> <queue> <ERROR> MAC layer could not send the packet (retries: %u)\n")
+MY_TRACE_EVENT(TRACE_QUEUE_RETRY_SCHEDULED, DEBUG, "<out> <queue> Retry %u of the packet in %u ticks\n")
+MY_TRACE_EVENT(TRACE_SINK_REPORT_TOO_SHORT, ERROR, "<in_> <packet> <ERROR> Packet is too short to contain a parent report\n")
+MY_TRACE_EVENT(TRACE_SINK_PATH_EMPTY, ERROR, "<in_> <packet> <ERROR> path_length value in header is wrong -> path_length is 0\n")
+MY_TRACE_EVENT(TRACE_SINK_PATH_TOO_SHORT, ERROR, "<in_> <packet> <ERROR> Packet is shorter than its path (path_length: %u)\n")
+MY_TRACE_EVENT(TRACE_SINK_HDRREDUCE_FAILED, ERROR, "<in_> <packet> <ERROR> Fail to reduce header. Packet will not be delivered to app!\n")
+MY_TRACE_EVENT(TRACE_SINK_TOPOLOGY_REPORT_RECEIVED, INFO, "<in_> <packet> <SUCCESS> Dedicated topology packet arrived to the sink (source: %02x:%02x, hops: %u)\n")
+MY_TRACE_EVENT(TRACE_SINK_PACKET_DELIVERED, INFO, "<in_> <packet> <SUCCESS> Packet arrived to the sink and delivered! (source: %02x:%02x, hops: %u)\n")
+MY_TRACE_EVENT(TRACE_BATCH_NO_PARENT, ERROR, "<out> <batch> <ERROR> Trying to send a batch but node's parent is missing!\n")
+MY_TRACE_EVENT(TRACE_BATCH_HDRALLOC_FAILED, ERROR, "<out> <batch> <ERROR> Trying to send a batch but node fails allocating header buffer!\n")
+MY_TRACE_EVENT(TRACE_BATCH_SENT, DEBUG, "<out> <batch> Sending batch (length: %u) to %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_BATCH_RECEIVED, DEBUG, "<in_> <batch> Received batch from %02x:%02x (length: %u)\n")
+MY_TRACE_EVENT(TRACE_BATCH_MALFORMED, ERROR, "<in_> <batch> <ERROR> Malformed batch record (offset: %u). Remaining records discarded\n")
+MY_TRACE_EVENT(TRACE_BATCH_NESTED, ERROR, "<in_> <batch> <ERROR> Nested batch record discarded\n")
+MY_TRACE_EVENT(TRACE_FORWARD_BATCHED, DEBUG, "<in_> <packet> Packet added to batch for %02x:%02x (current hops: %u)\n")
+MY_TRACE_EVENT(TRACE_FORWARD_SENT, DEBUG, "<in_> <packet> Packet forwarded to %02x:%02x (current hops: %u)\n")
+MY_TRACE_EVENT(TRACE_FORWARD_MAX_HOPS, ERROR, "<in_> <packet> <ERROR> Packet cannot be forwarded because it exceeded max hops (%u)\n")
+MY_TRACE_EVENT(TRACE_FORWARD_HDRREDUCE_FAILED, ERROR, "<in_> <packet> <ERROR> Fail to reduce header. Packet will not be forwarded!\n")
+MY_TRACE_EVENT(TRACE_FORWARD_HDRALLOC_FAILED, ERROR, "<in_> <packet> <ERROR> Trying to forward a data collection packet but node fails allocating header buffer!\n")
+MY_TRACE_EVENT(TRACE_FORWARD_NO_PARENT, ERROR, "<in_> <packet> <ERROR> Trying to forward a packet but node's parent is missing!\n")
+MY_TRACE_EVENT(TRACE_FORWARD_RECEIVED, DEBUG, "<in_> <packet> New collection packet to forward: (from: %02x:%02x, source: %02x:%02x, hops: %u, length: %u)\n")
+MY_TRACE_EVENT(TRACE_FORWARD_PATH_TOO_SHORT, ERROR, "<in_> <packet> <ERROR> Packet is shorter than its path (path_length: %u). Packet will not be forwarded!\n")
+MY_TRACE_EVENT(TRACE_FORWARD_LOOP, ERROR, "<in_> <packet> <ERROR> Packet cannot be forwarded beacuse a loop has been detected analyzing path\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_TREE_MALFORMED, ERROR, "<out> <command> <ERROR> Multicast routing tree is malformed. Remaining copies dropped\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_HDRALLOC_FAILED, ERROR, "<out> <command> <ERROR> Fail to allocate header for the copy to %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_COPY_SENT, DEBUG, "<out> <command> Multicast copy sent to %02x:%02x (current hops: %u, tree length: %u)\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_TOO_SHORT, ERROR, "<in_> <command> <ERROR> Multicast packet is shorter than its routing tree (tree length: %u)\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_DELIVERED, INFO, "<in_> <command> <SUCCESS> Multicast command arrived to the node! (source: %02x:%02x, hops: %u)\n")
+MY_TRACE_EVENT(TRACE_COMMAND_RECEIVED, DEBUG, "<out> <command> Received packet from %02x:%02x (header hops: %u, header path_length: %d)\n")
+MY_TRACE_EVENT(TRACE_COMMAND_AT_SINK, ERROR, "<in_> <command> <ERROR> Sink received a command packet! It will be discarded\n")
+MY_TRACE_EVENT(TRACE_COMMAND_TO_FORWARD, DEBUG, "<out> <command> Received packet to forward from %02x:%02x (current hops: %u, route length: %d)\n")
+MY_TRACE_EVENT(TRACE_COMMAND_FOR_NODE, DEBUG, "<in_> <command> Command will be delivered to node...\n")
+MY_TRACE_EVENT(TRACE_COMMAND_DELIVER_HDRREDUCE_FAILED, ERROR, "<in_> <command> <ERROR> Fail to reduce header. Command packet will not be delivered to app!\n")
+MY_TRACE_EVENT(TRACE_COMMAND_DELIVERED, INFO, "<in_> <command> <SUCCESS> Command arrived to the node! (source: %02x:%02x, hops: %u)\n")
+MY_TRACE_EVENT(TRACE_COMMAND_FORWARD_HDRREDUCE_FAILED, ERROR, "<out> <command> <ERROR> Fail to reduce header. Command packet will not be forwarded to the next node!\n")
+MY_TRACE_EVENT(TRACE_COMMAND_FORWARDED, DEBUG, "<out> <command> Packet forwarded to %02x:%02x (current hops: %u, route length: %d)\n")
+MY_TRACE_EVENT(TRACE_COMMAND_SEND_TRY, DEBUG, "<out> <command> Try to send command packet to %02x:%02x ...\n")
+MY_TRACE_EVENT(TRACE_COMMAND_NO_ROUTE, ERROR, "<out> <command> <ERROR> Cannot send command since source routing path cannot be created (loop detected or missing info)!\n")
+MY_TRACE_EVENT(TRACE_COMMAND_HDRALLOC_FAILED, ERROR, "<out> <command> <ERROR> Trying to send a command packet but node fails allocating header buffer!\n")
+MY_TRACE_EVENT(TRACE_COMMAND_ROUTE_FAILED, ERROR, "<out> <command> <ERROR> Cannot send command since source routing path cannot be created!\n")
+MY_TRACE_EVENT(TRACE_COMMAND_SENT, INFO, "<out> <command> Send command packet (dest: %02x:%02x, path_length: %d)\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_SEND_TRY, DEBUG, "<out> <command> Try to send multicast command packet to %d nodes ...\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_TOO_MANY_DESTINATIONS, ERROR, "<out> <command> <ERROR> Cannot send multicast command to %d nodes (max: %d)!\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_NO_ROUTE, ERROR, "<out> <command> <ERROR> No route to %02x:%02x. Destination skipped\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_DUPLICATE_DESTINATION, INFO, "<out> <command> Destination %02x:%02x listed more than once. Duplicate skipped\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_TREE_FULL, ERROR, "<out> <command> <ERROR> Multicast routing tree is full. Destination %02x:%02x skipped\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_NO_DESTINATION, ERROR, "<out> <command> <ERROR> Cannot send multicast command since no destination has a route!\n")
+MY_TRACE_EVENT(TRACE_MULTICAST_SENT, INFO, "<out> <command> Send multicast command packet (destinations: %d, tree nodes: %d, tree length: %d)\n")
+MY_TRACE_EVENT(TRACE_OPEN_SINK, INFO, "<open> Node is the sink (node: %02x:%02x).\n")
+MY_TRACE_EVENT(TRACE_OPEN_NO_ROUTING_TABLE, ERROR, "<open> <ERROR> Cannot open the sink without a routing table!\n")
+MY_TRACE_EVENT(TRACE_STATS_ATTACHED, DEBUG, "<out> <stats> Stats snapshot attached to the packet (length: %u)\n")
+MY_TRACE_EVENT(TRACE_STATS_REPORT_SENT, INFO, "<out> <stats> Sent dedicated stats report result: %d\n")
+MY_TRACE_EVENT(TRACE_SINK_STATS_MALFORMED, ERROR, "<in_> <stats> <ERROR> Malformed stats snapshot. Packet dropped\n")
+MY_TRACE_EVENT(TRACE_SINK_STATS_RECEIVED, INFO, "<in_> <stats> Stats of %02x:%02x (originated: %u, forwarded: %u, parent changes: %u, not acked: %u)\n")
+MY_TRACE_EVENT(TRACE_LATENCY_MEASURED, DEBUG, "<in_> <latency> Packet of %02x:%02x queued for %u ms in %u nodes (per node: min %u ms, max %u ms)\n")
+MY_TRACE_EVENT(TRACE_STAGGER_SYNCED, INFO, "<in_> <stagger> Cycle aligned to the parent %02x:%02x (phase: %u, slot: %u)\n")
+MY_TRACE_EVENT(TRACE_STAGGER_LISTEN, DEBUG, "<stagger> Radio kept on for the slot of the children: %d\n")
+MY_TRACE_EVENT(TRACE_TOPOLOGY_REPORT_SUPPRESSED, DEBUG, "<out> <toprep> Dedicated topology report skipped: the topology has been carried by an upward packet\n")
+MY_TRACE_EVENT(TRACE_TOPOLOGY_REPORT_DEFERRED, DEBUG, "<out> <toprep> No token for the dedicated topology report, retry in %u ticks\n")
+MY_TRACE_EVENT(TRACE_REPORT_CONTROL_UPDATED, INFO, "<in_> <toprep> Topology report rate set by the sink (period: %u s, burst: %u)\n")
+MY_TRACE_EVENT(TRACE_COMMAND_PENDING, INFO, "<out> <command> No route to %02x:%02x. Command kept until the route is discovered\n")
+MY_TRACE_EVENT(TRACE_COMMAND_PENDING_BUSY, ERROR, "<out> <command> <ERROR> No route to %02x:%02x while the command to %02x:%02x waits for its route. Command dropped\n")
+MY_TRACE_EVENT(TRACE_ROUTE_REQUEST_SENT, INFO, "<out> <rreq> Route request %u for %02x:%02x (target: %02x:%02x, request: %u)\n")
+MY_TRACE_EVENT(TRACE_ROUTE_DISCOVERED, INFO, "<in_> <rreq> Route to %02x:%02x discovered (requests: %u). Sending the command\n")
+MY_TRACE_EVENT(TRACE_ROUTE_DISCOVERY_FAILED, ERROR, "<out> <rreq> <ERROR> No route to %02x:%02x after %u requests. Command dropped\n")
+MY_TRACE_EVENT(TRACE_ROUTE_REQUEST_WRONG_SIZE, ERROR, "<in_> <rreq> <ERROR> Route request has wrong size. Request dropped\n")
+MY_TRACE_EVENT(TRACE_ROUTE_REQUEST_FORWARDED, DEBUG, "<out> <rreq> Forwarded route request %u (target: %02x:%02x, hops left: %u)\n")
+MY_TRACE_EVENT(TRACE_ROUTE_REQUEST_REPLIED, INFO, "<out> <rreq> Reply to route request %u (from %02x:%02x) with a topology report result: %d\n")
+
+/* Routing table (my_routing_table.c) ---------------------------------------------*/
+MY_TRACE_EVENT(TRACE_RT_UPDATE, DEBUG, "<routing_table> Updating table with <parent: %02x:%02x, child: %02x:%02x>\n")
+MY_TRACE_EVENT(TRACE_RT_NULL_CHILD, ERROR, "<routing_table> <ERROR> Child address is null. Entry discarded\n")
+MY_TRACE_EVENT(TRACE_RT_EVICTED, INFO, "<routing_table> Routing table is full (%d entries). Evicted child %02x:%02x (not heard for %u s)\n")
+MY_TRACE_EVENT(TRACE_RT_EXPIRED, DEBUG, "<routing_table> Expired child %02x:%02x (not heard for %u s)\n")
+MY_TRACE_EVENT(TRACE_RT_OLD_REPORT, DEBUG, "<routing_table> Discarded old report of %02x:%02x (epoch: %u, known epoch: %u)\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_SEARCH, DEBUG, "<routing_table> <find_route> Search route for %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_LOOP, ERROR, "<routing_table> <find_route> Fail to create route. Loop has been detected\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_STALE, ERROR, "<routing_table> <find_route> Link of %02x:%02x to its parent is stale (not heard for %u s)\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_MISSING_PARENT, ERROR, "<routing_table> <find_route> Fail to create route. Parent of %02x:%02x is missing\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_CACHED, DEBUG, "<routing_table> <find_route> Route for %02x:%02x found in cache (length: %d)\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_SHORT, ERROR, "<routing_table> <find_route> Route is shorter than expected (length: %d)\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_NOT_FROM_SINK, ERROR, "<routing_table> <find_route> Route search complete but not start from sink\n")
+MY_TRACE_EVENT(TRACE_RT_ROUTE_FOUND, DEBUG, "<routing_table> <find_route> Complete route found (length: %d)\n")
+MY_TRACE_EVENT(TRACE_TOPO_ADDED, INFO, "<topology> <add> %02x:%02x parent %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_TOPO_CHANGED, INFO, "<topology> <change> %02x:%02x parent %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_TOPO_REMOVED, INFO, "<topology> <remove> %02x:%02x\n")
+MY_TRACE_EVENT(TRACE_TOPO_SNAPSHOT_BEGIN, INFO, "<topology> <begin> snapshot %u entries %d\n")
+MY_TRACE_EVENT(TRACE_TOPO_ENTRY, INFO, "<topology> <entry> %02x:%02x parent %02x:%02x depth %d age %u\n")
+MY_TRACE_EVENT(TRACE_TOPO_SNAPSHOT_END, INFO, "<topology> <end> snapshot %u\n")
+
+/* Neighbor table (my_neighbor_table.c) -------------------------------------------*/
+MY_TRACE_EVENT(TRACE_NEIGHBOR_REPLACED, INFO, "<neighbors> Table is full. Neighbor %02x:%02x replaced\n")
+MY_TRACE_EVENT(TRACE_NEIGHBOR_LINK_UPDATED, DEBUG, "<neighbors> Link to %02x:%02x updated (acked: %d, tx: %d, link etx: %u)\n")
@@ -0,0 +1,24 @@
+#ifndef CONTIKI_H
+#define CONTIKI_H
+
+/* Simulator stand-in of the Contiki core headers used by the protocol (see sim.h) */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Clock of the node (same resolution and width as the Tmote Sky clock) */
+typedef unsigned short clock_time_t;
+#define CLOCK_SECOND 128
+
+clock_time_t clock_time(void);
+unsigned long clock_seconds(void);
+
+/* Output of the node: written as a Cooja log line (time, node id, text) */
+int sim_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+#define printf sim_printf
+
+#include "sys/ctimer.h"
+
+#endif  // CONTIKI_H
@@ -0,0 +1,9 @@
+#ifndef LEDS_H
+#define LEDS_H
+
+/* Simulator stand-in: nodes have no leds */
+#define leds_on(leds)
+#define leds_off(leds)
+#define leds_toggle(leds)
+
+#endif  // LEDS_H
@@ -0,0 +1,10 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+/* Simulator stand-in: numbers come from the seeded generator of the simulation */
+#define RANDOM_RAND_MAX 65535U
+
+void random_init(unsigned short seed);
+unsigned short random_rand(void);
+
+#endif  // RANDOM_H
@@ -0,0 +1,14 @@
+#ifndef MAC_H
+#define MAC_H
+
+/* Status of a transmission (passed to the sent callbacks) */
+enum {
+  MAC_TX_OK,
+  MAC_TX_COLLISION,
+  MAC_TX_NOACK,
+  MAC_TX_DEFERRED,
+  MAC_TX_ERR,
+  MAC_TX_ERR_FATAL,
+};
+
+#endif  // MAC_H
@@ -0,0 +1,17 @@
+#ifndef NETSTACK_H
+#define NETSTACK_H
+
+/* Simulator stand-in: the radio and MAC layers are modeled by broadcast_send()/unicast_send() */
+#include "net/mac/mac.h"
+
+/* Radio duty cycling driver: the simulated radio is always on (on/off only counted) */
+struct rdc_driver {
+  char *name;
+  int (*on)(void);
+  int (*off)(int keep_radio_on);
+};
+
+extern const struct rdc_driver sim_rdc_driver;
+#define NETSTACK_RDC sim_rdc_driver
+
+#endif  // NETSTACK_H
@@ -0,0 +1,76 @@
+#ifndef RIME_H
+#define RIME_H
+
+/* Simulator stand-in of the Rime primitives used by the protocol (see sim_rime.c) */
+
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+#include "net/mac/mac.h"
+
+/* Packet buffer: same sizes and semantics of the Contiki 3.0 packetbuf */
+#define PACKETBUF_SIZE     128
+#define PACKETBUF_HDR_SIZE 48
+
+typedef uint16_t packetbuf_attr_t;
+
+enum {
+  PACKETBUF_ATTR_RSSI,
+  PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+  PACKETBUF_ATTR_NUM_ATTRS
+};
+
+enum {
+  PACKETBUF_ADDR_SENDER,
+  PACKETBUF_ADDR_RECEIVER,
+  PACKETBUF_NUM_ADDRS
+};
+
+void packetbuf_clear(void);
+void *packetbuf_dataptr(void);
+void *packetbuf_hdrptr(void);
+uint16_t packetbuf_datalen(void);
+uint8_t packetbuf_hdrlen(void);
+uint16_t packetbuf_totlen(void);
+void packetbuf_set_datalen(uint16_t len);
+int packetbuf_copyfrom(const void *from, uint16_t len);
+int packetbuf_copyto(void *to);
+int packetbuf_hdralloc(int size);
+int packetbuf_hdrreduce(int size);
+int packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val);
+packetbuf_attr_t packetbuf_attr(uint8_t type);
+int packetbuf_set_addr(uint8_t type, const linkaddr_t *addr);
+const linkaddr_t *packetbuf_addr(uint8_t type);
+
+/* Broadcast and unicast connections (a frame is received by the connections with its channel) */
+struct broadcast_conn;
+struct unicast_conn;
+
+struct broadcast_callbacks {
+  void (*recv)(struct broadcast_conn *c, const linkaddr_t *sender);
+  void (*sent)(struct broadcast_conn *c, int status, int num_tx);
+};
+
+struct unicast_callbacks {
+  void (*recv)(struct unicast_conn *c, const linkaddr_t *from);
+  void (*sent)(struct unicast_conn *c, int status, int num_tx);
+};
+
+struct broadcast_conn {
+  uint16_t channel;
+  const struct broadcast_callbacks *u;
+};
+
+struct unicast_conn {
+  struct broadcast_conn c;
+  const struct unicast_callbacks *u;
+};
+
+void broadcast_open(struct broadcast_conn *c, uint16_t channel, const struct broadcast_callbacks *u);
+void broadcast_close(struct broadcast_conn *c);
+int broadcast_send(struct broadcast_conn *c);
+
+void unicast_open(struct unicast_conn *c, uint16_t channel, const struct unicast_callbacks *u);
+void unicast_close(struct unicast_conn *c);
+int unicast_send(struct unicast_conn *c, const linkaddr_t *receiver);
+
+#endif  // RIME_H
@@ -0,0 +1,26 @@
+#ifndef CTIMER_H
+#define CTIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "contiki.h"
+
+/* Simulator stand-in of the Contiki callback timers: a timer is an event of the node that set it */
+struct ctimer {
+  uint64_t expiration; // Simulated time (us)
+  clock_time_t interval;
+  void (*f)(void *);
+  void *ptr;
+  uint32_t node;
+  // Incremented when the timer is set or stopped (events of the previous settings are ignored)
+  uint32_t generation;
+  bool active;
+};
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr);
+void ctimer_reset(struct ctimer *c);
+void ctimer_restart(struct ctimer *c);
+void ctimer_stop(struct ctimer *c);
+int ctimer_expired(struct ctimer *c);
+
+#endif  // CTIMER_H
@@ -0,0 +1,381 @@
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "contiki.h"
+#include "lib/random.h"
+#include "sys/ctimer.h"
+#include "core/net/linkaddr.h"
+#include "sim.h"
+
+// Output of the simulator itself (see sim_printf() for the output of the nodes)
+#undef printf
+
+
+/* Sim vars ---------------------------------------------------------------------------*/
+
+static struct sim_node *nodes = NULL;
+static uint32_t nodes_count = 0;
+static struct sim_link *links = NULL;
+
+// Pending events: binary min-heap ordered by (time, order)
+static struct sim_event *events = NULL;
+static uint64_t events_count = 0;
+static uint64_t events_capacity = 0;
+static uint64_t events_order = 0;
+
+static uint64_t now = 0;
+static uint32_t current_node = 0;
+static uint64_t rng_state = 1;
+
+static bool verbose = false;
+// True if the next output of a node starts a new log line
+static bool line_start = true;
+
+linkaddr_t linkaddr_node_addr;
+const linkaddr_t linkaddr_null = {{0, 0}};
+
+
+/* Random numbers ---------------------------------------------------------------------*/
+
+// xorshift64* generator
+static uint64_t rng_next() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+uint32_t sim_random(uint32_t max) {
+  return max == 0 ? 0 : (uint32_t)((rng_next() >> 32) % max);
+}
+
+bool sim_chance(float p) {
+  return (rng_next() >> 40) < (uint64_t)(p * (float)(1 << 24));
+}
+
+void random_init(unsigned short seed) {
+  // The simulation generator is seeded once by sim_init()
+}
+
+unsigned short random_rand(void) {
+  return rng_next() >> 48;
+}
+
+
+/* Nodes ------------------------------------------------------------------------------*/
+
+void sim_init(uint32_t count, uint64_t seed) {
+  uint32_t i;
+
+  nodes = calloc(count, sizeof(struct sim_node));
+  nodes_count = count;
+  for (i = 0; i < count; i++) {
+    nodes[i].addr.u8[0] = (i + 1) & 0xFF;
+    nodes[i].addr.u8[1] = (i + 1) >> 8;
+    nodes[i].clock_offset = (clock_time_t)((i + 1) * 40503); // Spread over the clock range
+  }
+
+  // Avoid the all-zero state of xorshift
+  rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  now = 0;
+  events_count = 0;
+  events_order = 0;
+}
+
+void sim_free() {
+  free(nodes);
+  free(links);
+  free(events);
+  nodes = NULL;
+  links = NULL;
+  events = NULL;
+  nodes_count = 0;
+  events_count = events_capacity = 0;
+}
+
+uint32_t sim_node_count() {
+  return nodes_count;
+}
+
+struct sim_node* sim_node_get(uint32_t node) {
+  return &nodes[node];
+}
+
+int32_t sim_node_index(const linkaddr_t *addr) {
+  uint32_t id = addr->u8[0] | (addr->u8[1] << 8);
+
+  if (id == 0 || id > nodes_count) {
+    return -1;
+  }
+  return id - 1;
+}
+
+uint32_t sim_current_node() {
+  return current_node;
+}
+
+void sim_enter_node(uint32_t node) {
+  current_node = node;
+  linkaddr_node_addr = nodes[node].addr;
+  line_start = true;
+}
+
+
+/* Links ------------------------------------------------------------------------------*/
+
+// PRR of the link between two nodes at distance d (0 if not linked)
+static float link_prr(double d, double range, float prr, bool linear) {
+  if (d >= range) {
+    return 0;
+  }
+  if (linear && d > range / 2) {
+    return prr * (float)(2 * (range - d) / range);
+  }
+  return prr;
+}
+
+uint64_t sim_links_create(double range, float prr, bool linear) {
+  uint64_t count = 0;
+  uint32_t i, j;
+
+  // First pass: count the links of every node, second pass: fill them
+  for (i = 0; i < nodes_count; i++) {
+    nodes[i].links_count = 0;
+  }
+  for (i = 0; i < nodes_count; i++) {
+    for (j = i + 1; j < nodes_count; j++) {
+      double d = hypot(nodes[i].x - nodes[j].x, nodes[i].y - nodes[j].y);
+      if (link_prr(d, range, prr, linear) > 0) {
+        nodes[i].links_count++;
+        nodes[j].links_count++;
+        count += 2;
+      }
+    }
+  }
+
+  free(links);
+  links = malloc((count > 0 ? count : 1) * sizeof(struct sim_link));
+  count = 0;
+  for (i = 0; i < nodes_count; i++) {
+    nodes[i].links_offset = count;
+    count += nodes[i].links_count;
+    nodes[i].links_count = 0;
+  }
+
+  for (i = 0; i < nodes_count; i++) {
+    for (j = i + 1; j < nodes_count; j++) {
+      double d = hypot(nodes[i].x - nodes[j].x, nodes[i].y - nodes[j].y);
+      float p = link_prr(d, range, prr, linear);
+      if (p > 0) {
+        // RSSI from -40 dBm (same position) to -90 dBm (max range)
+        int16_t rssi = -40 - (int16_t)(50 * d / range);
+        struct sim_link *l = &links[nodes[i].links_offset + nodes[i].links_count++];
+        l->neighbor = j;
+        l->prr = p;
+        l->rssi = rssi;
+        l = &links[nodes[j].links_offset + nodes[j].links_count++];
+        l->neighbor = i;
+        l->prr = p;
+        l->rssi = rssi;
+      }
+    }
+  }
+
+  return count;
+}
+
+const struct sim_link* sim_link_get(uint32_t node, uint32_t neighbor) {
+  uint32_t i;
+
+  for (i = 0; i < nodes[node].links_count; i++) {
+    if (links[nodes[node].links_offset + i].neighbor == neighbor) {
+      return &links[nodes[node].links_offset + i];
+    }
+  }
+  return NULL;
+}
+
+const struct sim_link* sim_links_of(uint32_t node) {
+  return &links[nodes[node].links_offset];
+}
+
+
+/* Events -----------------------------------------------------------------------------*/
+
+static inline bool event_before(const struct sim_event *a, const struct sim_event *b) {
+  return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+void sim_schedule(uint32_t node, uint64_t delay, sim_event_handler handler, void *ptr, int32_t arg1, int32_t arg2) {
+  uint64_t i;
+
+  if (events_count == events_capacity) {
+    events_capacity = events_capacity > 0 ? events_capacity * 2 : 1024;
+    events = realloc(events, events_capacity * sizeof(struct sim_event));
+  }
+
+  struct sim_event event = {.time = now + delay, .order = events_order++, .node = node,
+    .handler = handler, .ptr = ptr, .arg1 = arg1, .arg2 = arg2};
+
+  // Sift up
+  i = events_count++;
+  while (i > 0 && event_before(&event, &events[(i - 1) / 2])) {
+    events[i] = events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  events[i] = event;
+}
+
+// Remove the first event of the heap and store it in "event"
+static void events_pop(struct sim_event *event) {
+  struct sim_event last;
+  uint64_t i = 0;
+
+  *event = events[0];
+  last = events[--events_count];
+
+  // Sift down
+  while (2 * i + 1 < events_count) {
+    uint64_t child = 2 * i + 1;
+    if (child + 1 < events_count && event_before(&events[child + 1], &events[child])) {
+      child++;
+    }
+    if (!event_before(&events[child], &last)) {
+      break;
+    }
+    events[i] = events[child];
+    i = child;
+  }
+  events[i] = last;
+}
+
+uint64_t sim_run(uint64_t end) {
+  struct sim_event event;
+  uint64_t run = 0;
+
+  while (events_count > 0 && events[0].time <= end) {
+    events_pop(&event);
+    now = event.time;
+    sim_enter_node(event.node);
+    event.handler(&event);
+    run++;
+  }
+
+  if (now < end) {
+    now = end;
+  }
+  return run;
+}
+
+uint64_t sim_time() {
+  return now;
+}
+
+
+/* Clock and timers -------------------------------------------------------------------*/
+
+static inline uint64_t ticks_to_time(clock_time_t ticks) {
+  return (uint64_t)ticks * SIM_SECOND / CLOCK_SECOND;
+}
+
+clock_time_t clock_time(void) {
+  return (clock_time_t)(now * CLOCK_SECOND / SIM_SECOND) + nodes[current_node].clock_offset;
+}
+
+unsigned long clock_seconds(void) {
+  return now / SIM_SECOND;
+}
+
+static void ctimer_event(struct sim_event *event) {
+  struct ctimer *c = (struct ctimer *)event->ptr;
+
+  if (!c->active || c->generation != (uint32_t)event->arg1) { // Stopped or set again
+    return;
+  }
+  c->active = false;
+  c->f(c->ptr);
+}
+
+// Schedule the expiration of the timer (events of its previous settings become stale)
+static void ctimer_schedule(struct ctimer *c) {
+  c->generation++;
+  c->active = true;
+  sim_schedule(c->node, c->expiration - now, ctimer_event, c, c->generation, 0);
+}
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr) {
+  c->f = f;
+  c->ptr = ptr;
+  c->interval = t;
+  c->node = current_node;
+  c->expiration = now + ticks_to_time(t);
+  ctimer_schedule(c);
+}
+
+void ctimer_reset(struct ctimer *c) {
+  // Next expiration counted from the previous one (no drift)
+  c->expiration += ticks_to_time(c->interval);
+  if (c->expiration < now) {
+    c->expiration = now;
+  }
+  ctimer_schedule(c);
+}
+
+void ctimer_restart(struct ctimer *c) {
+  c->expiration = now + ticks_to_time(c->interval);
+  ctimer_schedule(c);
+}
+
+void ctimer_stop(struct ctimer *c) {
+  c->active = false;
+  c->generation++;
+}
+
+int ctimer_expired(struct ctimer *c) {
+  return !c->active;
+}
+
+
+/* Addresses --------------------------------------------------------------------------*/
+
+void linkaddr_copy(linkaddr_t *dest, const linkaddr_t *from) {
+  memcpy(dest, from, LINKADDR_SIZE);
+}
+
+int linkaddr_cmp(const linkaddr_t *addr1, const linkaddr_t *addr2) {
+  return memcmp(addr1, addr2, LINKADDR_SIZE) == 0;
+}
+
+void linkaddr_set_node_addr(linkaddr_t *addr) {
+  linkaddr_copy(&linkaddr_node_addr, addr);
+}
+
+
+/* Output -----------------------------------------------------------------------------*/
+
+void sim_set_verbose(bool enable) {
+  verbose = enable;
+}
+
+int sim_printf(const char *format, ...) {
+  va_list args;
+  int res;
+
+  if (!verbose) {
+    return 0;
+  }
+
+  // Cooja log line (as written by test_nogui_dc.csc): <time (us)> ID:<node id> <text>
+  if (line_start) {
+    printf("%llu\tID:%u\t", (unsigned long long)now, current_node + 1);
+  }
+
+  va_start(args, format);
+  res = vprintf(format, args);
+  va_end(args);
+
+  line_start = format[0] != '\0' && format[strlen(format) - 1] == '\n';
+  return res;
+}
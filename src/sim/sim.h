@@ -0,0 +1,200 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+#include "net/rime/rime.h"
+
+/**
+ * Host-native discrete-event simulator of a network running the protocol.
+ *
+ * The protocol sources are compiled unmodified against stand-ins of the Contiki APIs
+ * (include/): every node is a set of events (timers, frame receptions, sent callbacks) run to
+ * completion in time order, with linkaddr_node_addr set to the address of the node running.
+ * Events at the same time run in the order they were scheduled, and all the random numbers
+ * (protocol, MAC and links) come from a single seeded generator: a run is fully deterministic.
+ *
+ * Radio model: a frame is received by every neighbor independently with the PRR of the link
+ * (no interference or collisions). A unicast is transmitted up to SIM_MAC_MAX_TRANSMISSIONS
+ * times until both the frame and its ACK get through, with a random backoff before every try.
+ */
+
+
+/* Sim config -------------------------------------------------------------------------*/
+
+// Max number of broadcast + unicast connections opened by a node
+#define SIM_MAX_CONNS 4
+
+// Radio: 250 kbps (32 us per byte) with PHY + MAC headers added to every frame
+#define SIM_BYTE_TIME       32
+#define SIM_FRAME_OVERHEAD  17
+#define SIM_ACK_TIME        (11 * SIM_BYTE_TIME + 192)
+
+// MAC: transmissions of a unicast and random backoff before a try (up to SIM_MAC_BACKOFF << try)
+#define SIM_MAC_MAX_TRANSMISSIONS 3
+#define SIM_MAC_BACKOFF           2000
+
+#define SIM_SECOND 1000000ULL
+
+
+/* Sim structs ------------------------------------------------------------------------*/
+
+/**
+ * Link from a node to a neighbor.
+ */
+struct sim_link {
+  uint32_t neighbor;
+  // Packet reception ratio (probability that a frame gets through)
+  float prr;
+  int16_t rssi;
+};
+
+/**
+ * Simulated node (the node with index i has address i + 1).
+ */
+struct sim_node {
+  linkaddr_t addr;
+  double x, y;
+  // Start of the clock of the node (clocks of different nodes are not aligned)
+  clock_time_t clock_offset;
+  // Outgoing links (range of sim.links)
+  uint32_t links_offset;
+  uint32_t links_count;
+  // Connections opened by the node
+  struct broadcast_conn *conns[SIM_MAX_CONNS];
+  bool conn_is_unicast[SIM_MAX_CONNS];
+  uint8_t conns_count;
+};
+
+/**
+ * Radio counters of the whole network.
+ */
+struct sim_radio_stats {
+  uint64_t broadcasts;
+  uint64_t broadcast_receptions;
+  uint64_t unicasts;
+  uint64_t unicast_transmissions; // Every try of every unicast
+  uint64_t unicast_receptions;
+  uint64_t unicasts_acked;
+  uint64_t rdc_off;               // Requests to keep the radio on (duty cycling off)
+};
+
+struct sim_event;
+typedef void (*sim_event_handler)(struct sim_event *event);
+
+/**
+ * Event scheduled at a time for a node.
+ */
+struct sim_event {
+  uint64_t time;
+  uint64_t order; // Scheduling order (ties of time)
+  uint32_t node;
+  sim_event_handler handler;
+  void *ptr;
+  int32_t arg1;
+  int32_t arg2;
+};
+
+
+/* Sim functions ----------------------------------------------------------------------*/
+
+/**
+ * Create "count" nodes (all at position 0, 0, without links) and seed the random generator.
+ *
+ */
+void sim_init(uint32_t count, uint64_t seed);
+
+/**
+ * Free nodes, links and pending events.
+ *
+ */
+void sim_free();
+
+uint32_t sim_node_count();
+
+struct sim_node* sim_node_get(uint32_t node);
+
+/**
+ * Return the index of the node with the given address, or -1 if there is no such node.
+ *
+ */
+int32_t sim_node_index(const linkaddr_t *addr);
+
+/**
+ * Index of the node running the current event.
+ *
+ */
+uint32_t sim_current_node();
+
+/**
+ * Set the links of every node: the pairs of nodes closer than "range" are linked in both
+ * directions with PRR "prr" (linear = false) or with a PRR decreasing linearly from "prr"
+ * (at half range) to zero (at range) (linear = true).
+ * Return the number of links.
+ */
+uint64_t sim_links_create(double range, float prr, bool linear);
+
+/**
+ * Return the links of a node (sim_node_get(node)->links_count entries).
+ *
+ */
+const struct sim_link* sim_links_of(uint32_t node);
+
+/**
+ * Return the link from node to neighbor, NULL if there is no such link.
+ *
+ */
+const struct sim_link* sim_link_get(uint32_t node, uint32_t neighbor);
+
+/**
+ * Schedule an event of a node "delay" us from now: the handler is called with the event
+ * (node, ptr and args) in the context of the node.
+ */
+void sim_schedule(uint32_t node, uint64_t delay, sim_event_handler handler, void *ptr, int32_t arg1, int32_t arg2);
+
+/**
+ * Run the events up to time "end" (us). Return the number of events run.
+ *
+ */
+uint64_t sim_run(uint64_t end);
+
+/**
+ * Current simulated time (us).
+ *
+ */
+uint64_t sim_time();
+
+/**
+ * Random number in [0, max) from the simulation generator.
+ *
+ */
+uint32_t sim_random(uint32_t max);
+
+/**
+ * Probability check: true with probability p.
+ *
+ */
+bool sim_chance(float p);
+
+/**
+ * Enable the output of the nodes (printf) on stdout as Cooja log lines.
+ *
+ */
+void sim_set_verbose(bool verbose);
+
+/**
+ * Radio counters since the start of the simulation (see sim_rime.c).
+ *
+ */
+const struct sim_radio_stats* sim_radio_stats_get();
+
+/**
+ * Enter the context of a node: following protocol calls run as the node.
+ *
+ */
+void sim_enter_node(uint32_t node);
+
+
+#endif  // SIM_H
@@ -0,0 +1,504 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/rime/rime.h"
+#include "my_collect.h"
+#include "my_trace.h"
+#include "sim.h"
+
+// Output of the simulator itself (the app output of the nodes uses sim_printf())
+#undef printf
+
+#if MY_TRACE_BINARY
+#error "Binary trace records are buffered by my_trace.c for the whole process: use text mode"
+#endif
+
+/**
+ * Scenario of the simulator: the app of app.c (node 1 is the sink, the other nodes send a
+ * packet to the sink every period, the sink sends a command to a node every command period)
+ * on a generated topology. At the end of the run prints PDR, latency and transmissions.
+ */
+
+
+/* Scenario config --------------------------------------------------------------------*/
+
+#define COLLECT_CHANNEL 0xAA
+
+// Send times remembered per node (a packet delivered more than this many packets later has no latency)
+#define APP_SEQN_WINDOW 64
+
+// Commands start after the tree had time to form (as in app.c)
+#define APP_COMMANDS_START (75 * SIM_SECOND)
+
+enum topology {
+  TOPOLOGY_GRID,
+  TOPOLOGY_RANDOM,
+  TOPOLOGY_LINE
+};
+
+struct scenario {
+  uint32_t nodes;
+  enum topology topology;
+  double range;
+  double degree; // Random topology: average number of neighbors
+  float prr;
+  bool linear;
+  uint64_t duration;
+  uint64_t msg_period;
+  uint64_t command_period;
+  uint64_t boot_spread;
+  uint64_t seed;
+  bool verbose;
+};
+
+
+/* App --------------------------------------------------------------------------------*/
+
+/* Application packet (same as app.c) */
+typedef struct {
+  uint16_t seqn;
+}
+__attribute__((packed))
+test_msg_t;
+
+/**
+ * App state of a node.
+ */
+struct app_node {
+  struct my_collect_conn *conn;
+  // Sink only
+  struct routing_table *routing_table;
+  struct ctimer periodic;
+  struct ctimer rnd;
+  uint16_t seqn;
+  // Upward packets sent by the node and received by the sink
+  uint32_t sent;
+  uint32_t received;
+  uint32_t duplicates;
+  // Commands sent to the node and received by it
+  uint32_t commands_sent;
+  uint32_t commands_received;
+  // Send time (us) of the last packets and commands (0 once received)
+  uint64_t sent_time[APP_SEQN_WINDOW];
+  uint64_t command_sent_time[APP_SEQN_WINDOW];
+};
+
+/**
+ * Totals of the run.
+ */
+struct app_totals {
+  uint64_t latency_sum;
+  uint64_t latency_max;
+  uint64_t hops_sum;
+  uint64_t command_latency_sum;
+  uint64_t command_latency_max;
+  uint64_t command_hops_sum;
+  uint32_t commands_not_sent;
+#if MY_COLLECT_LATENCY
+  // Queuing delays carried by the packets (ms): total, longest at a single node
+  uint64_t queuing_sum;
+  uint64_t command_queuing_sum;
+  uint16_t queuing_hop_max;
+  uint16_t command_queuing_hop_max;
+#endif
+};
+
+static struct scenario scenario;
+static struct app_node *app_nodes;
+static struct app_totals totals;
+static uint32_t next_dest = 1;
+
+static void recv_cb(const linkaddr_t *originator, uint8_t hops);
+static void sr_recv_cb(struct my_collect_conn *ptr, uint8_t hops);
+
+static const struct my_collect_callbacks sink_cb = {
+  .recv = recv_cb,
+  .sr_recv = NULL,
+};
+
+static const struct my_collect_callbacks node_cb = {
+  .recv = NULL,
+  .sr_recv = sr_recv_cb,
+};
+
+static void node_send_cb(void *ptr) {
+  struct app_node *app = (struct app_node *)ptr;
+  test_msg_t msg = {.seqn = app->seqn};
+
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), &msg, sizeof(msg));
+  packetbuf_set_datalen(sizeof(msg));
+  sim_printf("App: Send seqn %d\n", msg.seqn);
+
+  app->sent_time[app->seqn % APP_SEQN_WINDOW] = sim_time();
+  app->sent++;
+  app->seqn++;
+  my_collect_send(app->conn);
+}
+
+static void sink_send_cb(void *ptr) {
+  struct app_node *app = (struct app_node *)ptr;
+  struct app_node *dest_app = &app_nodes[next_dest];
+  const linkaddr_t *dest = &sim_node_get(next_dest)->addr;
+  test_msg_t msg = {.seqn = app->seqn};
+
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), &msg, sizeof(msg));
+  packetbuf_set_datalen(sizeof(msg));
+  sim_printf("App: sink sending seqn %d to %02x:%02x\n", msg.seqn, dest->u8[0], dest->u8[1]);
+
+  dest_app->command_sent_time[app->seqn % APP_SEQN_WINDOW] = sim_time();
+  dest_app->commands_sent++;
+  if (sr_send(app->conn, dest) == 0) {
+    sim_printf("App: sink could not send seqn %d to %02x:%02x\n", msg.seqn, dest->u8[0], dest->u8[1]);
+    totals.commands_not_sent++;
+  }
+
+  app->seqn++;
+  next_dest = next_dest + 1 < scenario.nodes ? next_dest + 1 : 1;
+}
+
+// Fixed interval, then a random shift within its first half (as in app.c)
+static void periodic_cb(void *ptr) {
+  struct app_node *app = (struct app_node *)ptr;
+  bool is_sink = app == &app_nodes[0];
+  uint64_t period = is_sink ? scenario.command_period : scenario.msg_period;
+  clock_time_t ticks = period * CLOCK_SECOND / SIM_SECOND;
+
+  ctimer_set(&app->periodic, ticks, periodic_cb, app);
+  ctimer_set(&app->rnd, random_rand() % (ticks / 2), is_sink ? sink_send_cb : node_send_cb, app);
+}
+
+static void boot_event(struct sim_event *event) {
+  struct app_node *app = &app_nodes[event->node];
+  bool is_sink = event->node == 0;
+
+  sim_printf("Rime started with address %d.%d\n", linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+  sim_printf(is_sink ? "App: I am sink %02x:%02x\n" : "App: I am normal node %02x:%02x\n",
+    linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+
+  // Connections are allocated separately, the routing table only for the sink
+  app->conn = calloc(1, sizeof(struct my_collect_conn));
+  if (is_sink) {
+    app->routing_table = calloc(1, sizeof(struct routing_table));
+  }
+  my_collect_open(app->conn, COLLECT_CHANNEL, is_sink, app->routing_table, is_sink ? &sink_cb : &node_cb);
+
+  if (is_sink && scenario.command_period > 0 && scenario.nodes > 1) {
+    clock_time_t start = APP_COMMANDS_START * CLOCK_SECOND / SIM_SECOND;
+    ctimer_set(&app->periodic, start, periodic_cb, app);
+  } else if (!is_sink && scenario.msg_period > 0) {
+    ctimer_set(&app->periodic, scenario.msg_period * CLOCK_SECOND / SIM_SECOND, periodic_cb, app);
+  }
+}
+
+static void recv_cb(const linkaddr_t *originator, uint8_t hops) {
+  int32_t node = sim_node_index(originator);
+  test_msg_t msg;
+
+  if (packetbuf_datalen() != sizeof(msg) || node < 0) {
+    sim_printf("App: wrong length: %d\n", packetbuf_datalen());
+    return;
+  }
+  memcpy(&msg, packetbuf_dataptr(), sizeof(msg));
+  sim_printf("App: Recv from %02x:%02x seqn %u hops %u\n", originator->u8[0], originator->u8[1], msg.seqn, hops);
+
+  struct app_node *app = &app_nodes[node];
+  uint64_t *sent_time = &app->sent_time[msg.seqn % APP_SEQN_WINDOW];
+  if (*sent_time == 0) { // Already received (or sent out of the window)
+    app->duplicates++;
+    return;
+  }
+  uint64_t latency = sim_time() - *sent_time;
+  *sent_time = 0;
+  app->received++;
+  totals.latency_sum += latency;
+  totals.hops_sum += hops;
+#if MY_COLLECT_LATENCY
+  const struct my_collect_latency *queuing = my_collect_latency_get(app_nodes[sim_current_node()].conn);
+  totals.queuing_sum += queuing->delay;
+  if (queuing->hop_delay_max > totals.queuing_hop_max) {
+    totals.queuing_hop_max = queuing->hop_delay_max;
+  }
+#endif
+  if (latency > totals.latency_max) {
+    totals.latency_max = latency;
+  }
+}
+
+static void sr_recv_cb(struct my_collect_conn *ptr, uint8_t hops) {
+  struct app_node *app = &app_nodes[sim_current_node()];
+  test_msg_t msg;
+
+  if (packetbuf_datalen() != sizeof(test_msg_t)) {
+    sim_printf("App: sr_recv wrong length: %d\n", packetbuf_datalen());
+    return;
+  }
+  memcpy(&msg, packetbuf_dataptr(), sizeof(test_msg_t));
+  sim_printf("App: sr_recv from sink seqn %u hops %u node metric %u\n", msg.seqn, hops, ptr->metric);
+
+  uint64_t *sent_time = &app->command_sent_time[msg.seqn % APP_SEQN_WINDOW];
+  if (*sent_time == 0) {
+    return;
+  }
+  uint64_t latency = sim_time() - *sent_time;
+  *sent_time = 0;
+  app->commands_received++;
+  totals.command_latency_sum += latency;
+  totals.command_hops_sum += hops;
+#if MY_COLLECT_LATENCY
+  const struct my_collect_latency *queuing = my_collect_latency_get(ptr);
+  totals.command_queuing_sum += queuing->delay;
+  if (queuing->hop_delay_max > totals.command_queuing_hop_max) {
+    totals.command_queuing_hop_max = queuing->hop_delay_max;
+  }
+#endif
+  if (latency > totals.command_latency_max) {
+    totals.command_latency_max = latency;
+  }
+}
+
+
+/* Topology ---------------------------------------------------------------------------*/
+
+// Place the nodes (node 1, the sink, at the origin) and create the links. Return the number of links
+static uint64_t topology_create() {
+  uint32_t n = scenario.nodes;
+  uint32_t side = (uint32_t)ceil(sqrt(n));
+  double area_side = sqrt(n * M_PI * scenario.range * scenario.range / scenario.degree);
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    struct sim_node *node = sim_node_get(i);
+
+    switch (scenario.topology) {
+      case TOPOLOGY_GRID: // Unit spacing
+        node->x = i % side;
+        node->y = i / side;
+        break;
+      case TOPOLOGY_RANDOM: // Uniform in a square sized for the average degree
+        node->x = i == 0 ? 0 : area_side * sim_random(1 << 20) / (1 << 20);
+        node->y = i == 0 ? 0 : area_side * sim_random(1 << 20) / (1 << 20);
+        break;
+      case TOPOLOGY_LINE:
+        node->x = i;
+        node->y = 0;
+        break;
+    }
+  }
+
+  return sim_links_create(scenario.range, scenario.prr, scenario.linear);
+}
+
+// Return the number of nodes connected to the sink (links with PRR > 0)
+static uint32_t topology_reachable() {
+  uint32_t *queue = malloc(scenario.nodes * sizeof(uint32_t));
+  bool *visited = calloc(scenario.nodes, sizeof(bool));
+  uint32_t head = 0, tail = 0;
+  uint32_t i;
+
+  queue[tail++] = 0;
+  visited[0] = true;
+  while (head < tail) {
+    uint32_t node = queue[head++];
+    const struct sim_link *links = sim_links_of(node);
+    for (i = 0; i < sim_node_get(node)->links_count; i++) {
+      if (!visited[links[i].neighbor]) {
+        visited[links[i].neighbor] = true;
+        queue[tail++] = links[i].neighbor;
+      }
+    }
+  }
+
+  free(queue);
+  free(visited);
+  return tail;
+}
+
+
+/* Report -----------------------------------------------------------------------------*/
+
+static double percent(uint64_t part, uint64_t total) {
+  return total > 0 ? 100.0 * part / total : 0;
+}
+
+static void report(uint64_t links, uint32_t reachable, uint64_t events, double wall_time) {
+  const struct sim_radio_stats *radio = sim_radio_stats_get();
+  uint64_t sent = 0, received = 0, duplicates = 0, commands_sent = 0, commands_received = 0;
+  uint64_t drops[MY_COLLECT_DROP_REASON_COUNT] = {0};
+  uint64_t parent_changes = 0;
+  uint32_t i, j;
+  static const char *drop_names[MY_COLLECT_DROP_REASON_COUNT] = {
+    "no parent", "no route", "loop", "max hops", "hdralloc", "hdrreduce",
+    "malformed", "duplicate", "queue full", "no ack"
+  };
+
+  for (i = 0; i < scenario.nodes; i++) {
+    sent += app_nodes[i].sent;
+    received += app_nodes[i].received;
+    duplicates += app_nodes[i].duplicates;
+    commands_sent += app_nodes[i].commands_sent;
+    commands_received += app_nodes[i].commands_received;
+    if (app_nodes[i].conn != NULL) {
+      const struct my_collect_stats *stats = my_collect_stats_get(app_nodes[i].conn);
+      parent_changes += stats->parent_changes;
+      for (j = 0; j < MY_COLLECT_DROP_REASON_COUNT; j++) {
+        drops[j] += stats->drops[j];
+      }
+    }
+  }
+
+  printf("----- Simulation -----\n");
+  printf("Nodes: %u (connected to the sink: %u), links: %llu (average degree %.1f)\n",
+    scenario.nodes, reachable, (unsigned long long)links, (double)links / scenario.nodes);
+  printf("Simulated time: %llu s, events: %llu, wall time: %.2f s\n",
+    (unsigned long long)(scenario.duration / SIM_SECOND), (unsigned long long)events, wall_time);
+
+  printf("----- Data Collection Overall Statistics -----\n");
+  printf("Total Number of Packets Sent: %llu\n", (unsigned long long)sent);
+  printf("Total Number of Packets Received: %llu (duplicates: %llu)\n",
+    (unsigned long long)received, (unsigned long long)duplicates);
+  printf("Overall PDR = %.2f%%\n", percent(received, sent));
+  printf("Latency: average %.1f ms, max %.1f ms, average hops %.2f\n",
+    received > 0 ? totals.latency_sum / 1000.0 / received : 0, totals.latency_max / 1000.0,
+    received > 0 ? (double)totals.hops_sum / received : 0);
+#if MY_COLLECT_LATENCY
+  printf("Queuing delay (carried by the packets): average %.1f ms, max at a node %u ms\n",
+    received > 0 ? (double)totals.queuing_sum / received : 0, totals.queuing_hop_max);
+#endif
+
+  printf("----- Source Routing Overall Statistics -----\n");
+  printf("Total Number of Packets Sent: %llu (not sent: %u)\n", (unsigned long long)commands_sent, totals.commands_not_sent);
+  printf("Total Number of Packets Received: %llu\n", (unsigned long long)commands_received);
+  printf("Overall PDR = %.2f%%\n", percent(commands_received, commands_sent));
+  printf("Latency: average %.1f ms, max %.1f ms, average hops %.2f\n",
+    commands_received > 0 ? totals.command_latency_sum / 1000.0 / commands_received : 0,
+    totals.command_latency_max / 1000.0,
+    commands_received > 0 ? (double)totals.command_hops_sum / commands_received : 0);
+#if MY_COLLECT_LATENCY
+  printf("Queuing delay (carried by the packets): average %.1f ms, max at a node %u ms\n",
+    commands_received > 0 ? (double)totals.command_queuing_sum / commands_received : 0,
+    totals.command_queuing_hop_max);
+#endif
+
+  printf("----- Transmissions -----\n");
+  printf("Beacons (broadcasts): %llu, receptions: %llu\n",
+    (unsigned long long)radio->broadcasts, (unsigned long long)radio->broadcast_receptions);
+  printf("Unicasts: %llu (acked: %.2f%%), transmissions: %llu (%.2f per unicast)\n",
+    (unsigned long long)radio->unicasts, percent(radio->unicasts_acked, radio->unicasts),
+    (unsigned long long)radio->unicast_transmissions,
+    radio->unicasts > 0 ? (double)radio->unicast_transmissions / radio->unicasts : 0);
+  printf("Transmissions per node per minute: %.2f\n",
+    (double)(radio->broadcasts + radio->unicast_transmissions) / scenario.nodes /
+    ((double)scenario.duration / SIM_SECOND / 60));
+  if (radio->rdc_off > 0) {
+    printf("Radio kept on (duty cycling off): %llu times\n", (unsigned long long)radio->rdc_off);
+  }
+  printf("Parent changes: %llu\n", (unsigned long long)parent_changes);
+  printf("Drops:");
+  for (j = 0; j < MY_COLLECT_DROP_REASON_COUNT; j++) {
+    printf(" %s %llu%s", drop_names[j], (unsigned long long)drops[j], j + 1 < MY_COLLECT_DROP_REASON_COUNT ? "," : "\n");
+  }
+}
+
+
+/* Main -------------------------------------------------------------------------------*/
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -n <nodes>      number of nodes, node 1 is the sink (default: 100)\n"
+    "  -t <topology>   grid (unit spacing), random or line (default: grid)\n"
+    "  -r <range>      radio range (default: 1.5)\n"
+    "  -k <degree>     random topology: average number of neighbors (default: 10)\n"
+    "  -p <prr>        PRR of the links (default: 0.95)\n"
+    "  -l              PRR decreasing linearly from half range to range\n"
+    "  -d <seconds>    simulated time (default: 1800)\n"
+    "  -i <seconds>    period of the packets sent by the nodes, 0 to disable (default: 30)\n"
+    "  -c <seconds>    period of the commands sent by the sink, 0 to disable (default: 10)\n"
+    "  -b <seconds>    nodes boot at a random time within this interval (default: 1)\n"
+    "  -s <seed>       seed of the random numbers (default: 1)\n"
+    "  -v              print the output of the nodes as Cooja log lines\n",
+    name);
+}
+
+int main(int argc, char **argv) {
+  struct timespec start, end;
+  uint64_t links, events;
+  uint32_t reachable, i;
+  int opt;
+
+  scenario = (struct scenario){.nodes = 100, .topology = TOPOLOGY_GRID, .range = 1.5, .degree = 10,
+    .prr = 0.95, .linear = false, .duration = 1800 * SIM_SECOND, .msg_period = 30 * SIM_SECOND,
+    .command_period = 10 * SIM_SECOND, .boot_spread = SIM_SECOND, .seed = 1, .verbose = false};
+
+  while ((opt = getopt(argc, argv, "n:t:r:k:p:ld:i:c:b:s:vh")) != -1) {
+    switch (opt) {
+      case 'n': scenario.nodes = strtoul(optarg, NULL, 10); break;
+      case 't':
+        if (strcmp(optarg, "grid") == 0) {
+          scenario.topology = TOPOLOGY_GRID;
+        } else if (strcmp(optarg, "random") == 0) {
+          scenario.topology = TOPOLOGY_RANDOM;
+        } else if (strcmp(optarg, "line") == 0) {
+          scenario.topology = TOPOLOGY_LINE;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'r': scenario.range = atof(optarg); break;
+      case 'k': scenario.degree = atof(optarg); break;
+      case 'p': scenario.prr = atof(optarg); break;
+      case 'l': scenario.linear = true; break;
+      case 'd': scenario.duration = (uint64_t)(atof(optarg) * SIM_SECOND); break;
+      case 'i': scenario.msg_period = (uint64_t)(atof(optarg) * SIM_SECOND); break;
+      case 'c': scenario.command_period = (uint64_t)(atof(optarg) * SIM_SECOND); break;
+      case 'b': scenario.boot_spread = (uint64_t)(atof(optarg) * SIM_SECOND); break;
+      case 's': scenario.seed = strtoull(optarg, NULL, 10); break;
+      case 'v': scenario.verbose = true; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  // Addresses are 16 bits, periods must fit the 16-bit clock of the nodes
+  if (scenario.nodes == 0 || scenario.nodes > 0xFFFF || scenario.range <= 0 || scenario.degree <= 0 ||
+      scenario.msg_period >= 256 * SIM_SECOND || scenario.command_period >= 256 * SIM_SECOND) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  sim_init(scenario.nodes, scenario.seed);
+  sim_set_verbose(scenario.verbose);
+  app_nodes = calloc(scenario.nodes, sizeof(struct app_node));
+
+  links = topology_create();
+  reachable = topology_reachable();
+  for (i = 0; i < scenario.nodes; i++) {
+    sim_schedule(i, sim_random(scenario.boot_spread + 1), boot_event, NULL, 0, 0);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  events = sim_run(scenario.duration);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fflush(stdout);
+
+  report(links, reachable, events,
+    (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+  for (i = 0; i < scenario.nodes; i++) {
+    free(app_nodes[i].conn);
+    free(app_nodes[i].routing_table);
+  }
+  free(app_nodes);
+  sim_free();
+  return 0;
+}
@@ -0,0 +1,334 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "net/mac/mac.h"
+#include "net/netstack.h"
+#include "sim.h"
+
+
+/* Packet buffer ----------------------------------------------------------------------*/
+
+// Header space grows backwards from PACKETBUF_HDR_SIZE, data starts at PACKETBUF_HDR_SIZE + bufptr
+static uint8_t packetbuf[PACKETBUF_HDR_SIZE + PACKETBUF_SIZE];
+static uint16_t buflen = 0;
+static uint16_t bufptr = 0;
+static uint8_t hdrptr = PACKETBUF_HDR_SIZE;
+
+static packetbuf_attr_t attrs[PACKETBUF_ATTR_NUM_ATTRS];
+static linkaddr_t addrs[PACKETBUF_NUM_ADDRS];
+
+void packetbuf_clear(void) {
+  buflen = bufptr = 0;
+  hdrptr = PACKETBUF_HDR_SIZE;
+  memset(attrs, 0, sizeof(attrs));
+  memset(addrs, 0, sizeof(addrs));
+}
+
+void *packetbuf_dataptr(void) {
+  return &packetbuf[PACKETBUF_HDR_SIZE + bufptr];
+}
+
+void *packetbuf_hdrptr(void) {
+  return &packetbuf[hdrptr];
+}
+
+uint16_t packetbuf_datalen(void) {
+  return buflen;
+}
+
+uint8_t packetbuf_hdrlen(void) {
+  return PACKETBUF_HDR_SIZE - hdrptr;
+}
+
+uint16_t packetbuf_totlen(void) {
+  return packetbuf_hdrlen() + packetbuf_datalen();
+}
+
+void packetbuf_set_datalen(uint16_t len) {
+  buflen = len;
+}
+
+int packetbuf_copyfrom(const void *from, uint16_t len) {
+  uint16_t l = len < PACKETBUF_SIZE ? len : PACKETBUF_SIZE;
+
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), from, l);
+  buflen = l;
+  return l;
+}
+
+int packetbuf_copyto(void *to) {
+  if (packetbuf_totlen() > PACKETBUF_SIZE) {
+    return 0;
+  }
+  memcpy(to, packetbuf_hdrptr(), packetbuf_hdrlen());
+  memcpy((uint8_t *)to + packetbuf_hdrlen(), packetbuf_dataptr(), buflen);
+  return packetbuf_totlen();
+}
+
+int packetbuf_hdralloc(int size) {
+  if (size <= hdrptr && packetbuf_totlen() + size <= PACKETBUF_SIZE) {
+    hdrptr -= size;
+    return 1;
+  }
+  return 0;
+}
+
+int packetbuf_hdrreduce(int size) {
+  if (buflen < size) {
+    return 0;
+  }
+  bufptr += size;
+  buflen -= size;
+  return 1;
+}
+
+int packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val) {
+  attrs[type] = val;
+  return 1;
+}
+
+packetbuf_attr_t packetbuf_attr(uint8_t type) {
+  return attrs[type];
+}
+
+int packetbuf_set_addr(uint8_t type, const linkaddr_t *addr) {
+  linkaddr_copy(&addrs[type], addr);
+  return 1;
+}
+
+const linkaddr_t *packetbuf_addr(uint8_t type) {
+  return &addrs[type];
+}
+
+
+/* Radio ------------------------------------------------------------------------------*/
+
+/**
+ * Frame on the air (shared by the events of its receptions and of its sent callback).
+ */
+struct frame {
+  int refs;
+  bool is_unicast;
+  uint16_t channel;
+  linkaddr_t sender;
+  linkaddr_t receiver;
+  uint16_t length;
+  uint8_t data[PACKETBUF_SIZE];
+};
+
+static struct sim_radio_stats radio_stats;
+
+const struct sim_radio_stats* sim_radio_stats_get() {
+  return &radio_stats;
+}
+
+static int rdc_on(void) {
+  return 1;
+}
+
+static int rdc_off(int keep_radio_on) {
+  if (keep_radio_on) {
+    radio_stats.rdc_off++;
+  }
+  return 1;
+}
+
+const struct rdc_driver sim_rdc_driver = {.name = "sim", .on = rdc_on, .off = rdc_off};
+
+// Copy packetbuf into a new frame (NULL if packetbuf does not fit a frame)
+static struct frame* frame_create(uint16_t channel, bool is_unicast, const linkaddr_t *receiver) {
+  struct frame *f = malloc(sizeof(struct frame));
+
+  f->length = packetbuf_copyto(f->data);
+  if (f->length == 0 && packetbuf_totlen() > 0) {
+    free(f);
+    return NULL;
+  }
+  f->refs = 0;
+  f->is_unicast = is_unicast;
+  f->channel = channel;
+  linkaddr_copy(&f->sender, &linkaddr_node_addr);
+  linkaddr_copy(&f->receiver, receiver);
+  return f;
+}
+
+static void frame_release(struct frame *f) {
+  if (--f->refs == 0) {
+    free(f);
+  }
+}
+
+// Air time of a frame (us)
+static inline uint64_t frame_time(const struct frame *f) {
+  return (uint64_t)(f->length + SIM_FRAME_OVERHEAD) * SIM_BYTE_TIME;
+}
+
+// Put the frame in packetbuf as seen by the receiver
+static void frame_to_packetbuf(const struct frame *f, int16_t rssi) {
+  packetbuf_copyfrom(f->data, f->length);
+  packetbuf_set_attr(PACKETBUF_ATTR_RSSI, (packetbuf_attr_t)rssi);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &f->sender);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &f->receiver);
+}
+
+// Connection of the current node receiving the frame (NULL if none)
+static struct broadcast_conn* frame_conn(const struct frame *f) {
+  struct sim_node *node = sim_node_get(sim_current_node());
+  int i;
+
+  for (i = 0; i < node->conns_count; i++) {
+    if (node->conns[i]->channel == f->channel && node->conn_is_unicast[i] == f->is_unicast) {
+      return node->conns[i];
+    }
+  }
+  return NULL;
+}
+
+// Event: frame received by the node (arg1: RSSI)
+static void frame_recv_event(struct sim_event *event) {
+  struct frame *f = (struct frame *)event->ptr;
+  struct broadcast_conn *c = frame_conn(f);
+
+  if (c != NULL) {
+    frame_to_packetbuf(f, event->arg1);
+    if (f->is_unicast) {
+      radio_stats.unicast_receptions++;
+      struct unicast_conn *uc = (struct unicast_conn *)c;
+      if (uc->u->recv != NULL) {
+        uc->u->recv(uc, &f->sender);
+      }
+    } else {
+      radio_stats.broadcast_receptions++;
+      if (c->u->recv != NULL) {
+        c->u->recv(c, &f->sender);
+      }
+    }
+  }
+  frame_release(f);
+}
+
+// Event: end of the transmission of a unicast (arg1: status, arg2: number of transmissions)
+static void frame_sent_event(struct sim_event *event) {
+  struct frame *f = (struct frame *)event->ptr;
+  struct unicast_conn *uc = (struct unicast_conn *)frame_conn(f);
+
+  if (uc != NULL && uc->u->sent != NULL) {
+    frame_to_packetbuf(f, 0);
+    uc->u->sent(uc, event->arg1, event->arg2);
+  }
+  frame_release(f);
+}
+
+static void conn_add(struct broadcast_conn *c, bool is_unicast) {
+  struct sim_node *node = sim_node_get(sim_current_node());
+
+  if (node->conns_count == SIM_MAX_CONNS) {
+    fprintf(stderr, "sim: node %u opened more than %d connections\n", sim_current_node() + 1, SIM_MAX_CONNS);
+    exit(1);
+  }
+  node->conns[node->conns_count] = c;
+  node->conn_is_unicast[node->conns_count] = is_unicast;
+  node->conns_count++;
+}
+
+static void conn_remove(struct broadcast_conn *c) {
+  struct sim_node *node = sim_node_get(sim_current_node());
+  int i;
+
+  for (i = 0; i < node->conns_count; i++) {
+    if (node->conns[i] == c) {
+      node->conns_count--;
+      node->conns[i] = node->conns[node->conns_count];
+      node->conn_is_unicast[i] = node->conn_is_unicast[node->conns_count];
+      return;
+    }
+  }
+}
+
+void broadcast_open(struct broadcast_conn *c, uint16_t channel, const struct broadcast_callbacks *u) {
+  c->channel = channel;
+  c->u = u;
+  conn_add(c, false);
+}
+
+void broadcast_close(struct broadcast_conn *c) {
+  conn_remove(c);
+}
+
+int broadcast_send(struct broadcast_conn *c) {
+  uint32_t node = sim_current_node();
+  const struct sim_link *links = sim_links_of(node);
+  uint32_t i;
+
+  struct frame *f = frame_create(c->channel, false, &linkaddr_null);
+  if (f == NULL) {
+    return 0;
+  }
+  radio_stats.broadcasts++;
+
+  // Every neighbor receives the frame independently at the end of its transmission
+  uint64_t delay = sim_random(SIM_MAC_BACKOFF) + frame_time(f);
+  f->refs = 1;
+  for (i = 0; i < sim_node_get(node)->links_count; i++) {
+    if (sim_chance(links[i].prr)) {
+      f->refs++;
+      sim_schedule(links[i].neighbor, delay, frame_recv_event, f, links[i].rssi, 0);
+    }
+  }
+  frame_release(f);
+  return 1;
+}
+
+void unicast_open(struct unicast_conn *c, uint16_t channel, const struct unicast_callbacks *u) {
+  c->c.channel = channel;
+  c->c.u = NULL;
+  c->u = u;
+  conn_add(&c->c, true);
+}
+
+void unicast_close(struct unicast_conn *c) {
+  conn_remove(&c->c);
+}
+
+int unicast_send(struct unicast_conn *c, const linkaddr_t *receiver) {
+  uint32_t node = sim_current_node();
+  int32_t neighbor = sim_node_index(receiver);
+  const struct sim_link *link = neighbor >= 0 ? sim_link_get(node, neighbor) : NULL;
+  bool received = false;
+  bool acked = false;
+  int num_tx = 0;
+  uint64_t delay = 0;
+
+  struct frame *f = frame_create(c->c.channel, true, receiver);
+  if (f == NULL) {
+    return 0;
+  }
+  radio_stats.unicasts++;
+  f->refs = 1;
+
+  // Transmissions until the frame is acknowledged: a frame received again after a lost ACK
+  // is dropped by the MAC of the receiver (only the first reception is delivered)
+  while (!acked && num_tx < SIM_MAC_MAX_TRANSMISSIONS) {
+    delay += sim_random(SIM_MAC_BACKOFF << num_tx) + frame_time(f);
+    num_tx++;
+    radio_stats.unicast_transmissions++;
+
+    if (link != NULL && sim_chance(link->prr)) {
+      if (!received) {
+        received = true;
+        f->refs++;
+        sim_schedule(neighbor, delay, frame_recv_event, f, link->rssi, 0);
+      }
+      acked = sim_chance(link->prr);
+      delay += SIM_ACK_TIME;
+    }
+  }
+
+  if (acked) {
+    radio_stats.unicasts_acked++;
+  }
+  sim_schedule(node, delay, frame_sent_event, f, acked ? MAC_TX_OK : MAC_TX_NOACK, num_tx);
+  return 1;
+}
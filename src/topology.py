@@ -0,0 +1,226 @@
+#!/usr/bin/env python2.7
+
+# Rebuild the collection tree from the topology export of the sink (ROUTING_TABLE_CONF_EXPORT=1):
+# periodic snapshots of the routing table replace the tree, the change records in between update it.
+# Binary trace records (MY_TRACE_CONF_BINARY=1) are decoded on the fly.
+#
+# Usage: topology.py [-f] [-F dot|json] [-o <output file>] [-u us|ms|s] <log file or - for stdin>
+#   -f: follow the log as it grows and rewrite the output file whenever the tree changes (live graph)
+#   -u: unit of the time of Cooja log lines (lines without it are timed with the wall clock)
+
+from __future__ import division, print_function
+
+import argparse
+import json
+import os
+import os.path
+import re
+import sys
+import time
+
+record_pattern = r"(?:(?P<time>[\w:.]+)\s+ID:(?P<self_id>\d+)\s+)?.*?<topology> %s"
+regex_delta = re.compile(record_pattern % r"<(?P<kind>add|change)> (?P<child>\w+:\w+) parent (?P<parent>\w+:\w+)")
+regex_remove = re.compile(record_pattern % r"<remove> (?P<child>\w+:\w+)")
+regex_begin = re.compile(record_pattern % r"<begin> snapshot (?P<seqn>\d+) entries (?P<count>\d+)")
+regex_entry = re.compile(record_pattern %
+	r"<entry> (?P<child>\w+:\w+) parent (?P<parent>\w+:\w+) depth (?P<depth>\d+) age (?P<age>\d+)")
+regex_end = re.compile(record_pattern % r"<end> snapshot (?P<seqn>\d+)")
+
+time_units = {"us": 1e6, "ms": 1e3, "s": 1}
+
+class Topology(object):
+	def __init__(self):
+		self.sink = None
+		self.parents = {} # child -> parent
+		self.heard = {} # child -> time last heard
+		self.time = 0
+		self.snapshot = None # seqn of the last snapshot applied
+		self.pending = None # (seqn, expected entries, parents, heard) of the snapshot being received
+		self.snapshots = 0
+		self.deltas = 0
+		self.changed = False
+
+	def depth(self, node):
+		depth = 0
+		while node != self.sink:
+			if node not in self.parents or depth > len(self.parents):
+				return None # Parent missing or loop
+			node = self.parents[node]
+			depth += 1
+		return depth
+
+	def parse_line(self, line, unit):
+		m = regex_delta.match(line) or regex_remove.match(line) or regex_begin.match(line) \
+			or regex_entry.match(line) or regex_end.match(line)
+		if not m:
+			return
+
+		self.time = parse_time(m.group("time"), unit)
+		if m.group("self_id"):
+			self.sink = "{:02x}:00".format(int(m.group("self_id")))
+		re_matched = m.re
+
+		if re_matched is regex_delta:
+			self.parents[m.group("child")] = m.group("parent")
+			self.heard[m.group("child")] = self.time
+			self.deltas += 1
+			self.changed = True
+
+		elif re_matched is regex_remove:
+			self.parents.pop(m.group("child"), None)
+			self.heard.pop(m.group("child"), None)
+			self.deltas += 1
+			self.changed = True
+
+		elif re_matched is regex_begin:
+			self.pending = (int(m.group("seqn")), int(m.group("count")), {}, {})
+
+		elif re_matched is regex_entry:
+			if self.pending is None:
+				return # Begin of the snapshot lost
+			self.pending[2][m.group("child")] = m.group("parent")
+			self.pending[3][m.group("child")] = self.time - int(m.group("age"))
+
+		elif re_matched is regex_end:
+			if self.pending is None or self.pending[0] != int(m.group("seqn")):
+				print("Warning: snapshot {} without begin, ignored".format(m.group("seqn")), file=sys.stderr)
+				self.pending = None
+				return
+			seqn, count, parents, heard = self.pending
+			if len(parents) != count:
+				print("Warning: snapshot {} has {} entries instead of {}".format(seqn, len(parents), count),
+					file=sys.stderr)
+			self.parents, self.heard = parents, heard
+			self.snapshot = seqn
+			self.snapshots += 1
+			self.pending = None
+			self.changed = True
+
+	def nodes(self):
+		nodes = []
+		for child in sorted(self.parents):
+			nodes.append({
+				"id": child,
+				"parent": self.parents[child],
+				"depth": self.depth(child),
+				"last_heard": round(self.heard[child], 3),
+				"age": round(self.time - self.heard[child], 3)})
+		return nodes
+
+	def to_json(self):
+		return json.dumps({
+			"time": round(self.time, 3),
+			"sink": self.sink,
+			"snapshot": self.snapshot,
+			"nodes": self.nodes()}, indent=1, separators=(",", ": "), sort_keys=True) + "\n"
+
+	def to_dot(self):
+		lines = ["digraph topology {",
+			"\tlabel=\"t = {:.1f} s, snapshot {}, {} nodes\";".format(self.time, self.snapshot, len(self.parents))]
+		if self.sink:
+			lines.append("\t\"{}\" [shape=doublecircle];".format(self.sink))
+		for node in self.nodes():
+			# Nodes whose chain of parents does not reach the sink are dashed
+			style = "" if node["depth"] is not None else ", style=dashed"
+			lines.append("\t\"{}\" [label=\"{}\\nd{} {:.0f}s\"{}];".format(node["id"], node["id"],
+				node["depth"] if node["depth"] is not None else "?", node["age"], style))
+			lines.append("\t\"{}\" -> \"{}\";".format(node["id"], node["parent"]))
+		lines.append("}")
+		return "\n".join(lines) + "\n"
+
+def parse_time(value, unit):
+	if value is None:
+		return time.time()
+	if value.isdigit():
+		return int(value) / time_units[unit]
+	# Cooja GUI format: [[hh:]mm:]ss.mmm
+	seconds = 0
+	for field in value.split(":"):
+		seconds = seconds * 60 + float(field)
+	return seconds
+
+def load_decoder():
+	# Records of the binary trace mode are decoded with decode-trace.py
+	directory = os.path.dirname(os.path.abspath(__file__))
+	path = os.path.join(directory, "decode-trace.py")
+	try:
+		import importlib.util
+		spec = importlib.util.spec_from_file_location("decode_trace", path)
+		decoder = importlib.util.module_from_spec(spec)
+		spec.loader.exec_module(decoder)
+	except ImportError:
+		import imp
+		decoder = imp.load_source("decode_trace", path)
+	return decoder, decoder.parse_events(os.path.join(directory, "my_trace_events.h"))
+
+def decode_line(decoder, events, line):
+	index = line.find(decoder.line_prefix + " ")
+	if index < 0:
+		return [line]
+	prefix = line[:index]
+	lines = []
+	for token in line[index + len(decoder.line_prefix):].split():
+		try:
+			lines.append(prefix + decoder.decode_token(events, token)[1])
+		except ValueError:
+			pass
+	return lines
+
+def write_output(topology, output_file, output_format):
+	text = topology.to_json() if output_format == "json" else topology.to_dot()
+	if output_file is None:
+		sys.stdout.write(text)
+		return
+	# Replace the file at once (it may be watched by a viewer)
+	tmp_file = output_file + ".tmp"
+	with open(tmp_file, 'w') as f:
+		f.write(text)
+	os.rename(tmp_file, output_file)
+
+def parse_file(f, args):
+	decoder, events = load_decoder()
+	topology = Topology()
+	partial = ""
+
+	while True:
+		line = f.readline()
+		# A line still being written is completed by the next read (last line of the log if not following)
+		if line.endswith("\n") or (line and not args.follow):
+			for decoded in decode_line(decoder, events, (partial + line).rstrip("\n")):
+				topology.parse_line(decoded, args.unit)
+			partial = ""
+			continue
+
+		partial += line
+		if not args.follow:
+			break
+		# End of the log for now: publish the tree and wait for more lines
+		if topology.changed:
+			write_output(topology, args.output_file, args.format)
+			topology.changed = False
+		time.sleep(0.5)
+
+	write_output(topology, args.output_file, args.format)
+	print("{} nodes, {} snapshots, {} change records".format(len(topology.parents), topology.snapshots,
+		topology.deltas), file=sys.stderr)
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description="Rebuild the collection tree from the topology export of the sink")
+	parser.add_argument("-f", dest="follow", action="store_true", help="follow the log as it grows")
+	parser.add_argument("-F", dest="format", choices=["dot", "json"], default="dot", help="output format")
+	parser.add_argument("-o", dest="output_file", help="output file (default: stdout)")
+	parser.add_argument("-u", dest="unit", choices=sorted(time_units), default="us", help="unit of the log time")
+	parser.add_argument("log_file")
+	args = parser.parse_args()
+
+	if args.log_file == "-":
+		parse_file(sys.stdin, args)
+	elif not os.path.isfile(args.log_file):
+		print("Error: file not found")
+		sys.exit(1)
+	else:
+		with open(args.log_file, 'r') as f:
+			try:
+				parse_file(f, args)
+			except KeyboardInterrupt:
+				pass